@@ -0,0 +1,70 @@
+#include "benchmarks.h"
+
+using MT = net::message_types;
+
+class accepting_server : public net::server_interface<MT> {
+public:
+	accepting_server(uint16_t port, const net::server_options& options)
+		: net::server_interface<MT>(port, options)
+	{}
+
+	~accepting_server() { this->stop(); }
+
+protected:
+	bool onClientConnect(net::ref<net::connection<MT>> client) override { return true; }
+};
+
+// Connectors open a connection, wait for the server's handshake and close it again, over and
+// over. Prints the connections established per second.
+static void measure(uint16_t port, size_t acceptsInFlight, size_t ioThreads, size_t connectors, size_t connections) {
+	net::server_options options;
+	options.ioThreads = ioThreads;
+	options.acceptsInFlight = acceptsInFlight;
+
+	// The server logs every connection, keep that out of the results
+	std::streambuf* coutBuffer = std::cout.rdbuf(nullptr);
+
+	std::atomic<size_t> nEstablished{ 0 };
+	double seconds;
+	{
+		accepting_server server(port, options);
+		server.start();
+
+		std::atomic<size_t> nStarted{ 0 };
+		std::vector<std::thread> vecConnectors;
+		auto start = bench_clock::now();
+		for (size_t i = 0; i < connectors; i++)
+			vecConnectors.emplace_back([&]() {
+				asio::io_context context;
+				asio::ip::tcp::endpoint endpoint(asio::ip::make_address("127.0.0.1"), port);
+				uint64_t handshake = 0;
+				while (nStarted++ < connections && secondsSince(start) < 60) {
+					asio::ip::tcp::socket socket(context);
+					std::error_code ec;
+					socket.connect(endpoint, ec);
+					if (!ec) asio::read(socket, asio::buffer(&handshake, sizeof(handshake)), ec);
+					if (!ec) nEstablished++;
+				}
+			});
+		for (std::thread& thread : vecConnectors)
+			thread.join();
+		seconds = secondsSince(start);
+	}
+
+	std::cout.rdbuf(coutBuffer);
+
+	std::cout << acceptsInFlight << "\t" << ioThreads << "\t" << nEstablished << "\t\t" << size_t(double(nEstablished) / seconds) << "\n";
+}
+
+int runAcceptBenchmark(int argc, char** argv) {
+	size_t connections = argOr(argc, argv, "connections", 10000);
+	size_t connectors = argOr(argc, argv, "connectors", 8);
+	size_t ioThreads = argOr(argc, argv, "threads", 4);
+	size_t accepts = argOr(argc, argv, "accepts", 8);
+	uint16_t port = uint16_t(argOr(argc, argv, "port", 61400));
+
+	std::cout << "accepts\tthreads\testablished\tconnections/s\n";
+	measure(port, 1, ioThreads, connectors, connections);
+	measure(uint16_t(port + 1), accepts, ioThreads, connectors, connections);
+	return 0;
+}
@@ -0,0 +1,30 @@
+#include "benchmarks.h"
+
+struct benchmark {
+	const char* name;
+	const char* description;
+	int (*run)(int, char**);
+};
+
+static const benchmark benchmarks[] = {
+	{ "queue", "Inbound queue contention, tsqueue vs mpsc_queue [--items=N --max-producers=N]", runQueueBenchmark },
+	{ "throughput", "Echo round trips per second as the server's io threads, or shards with --sharded=1, double [--max-threads=N --sharded=0|1 --clients=N --window=N --payload=N --seconds=N]", runThroughputBenchmark },
+	{ "latency", "Ping round trip p50/p99 with blocking and busy-poll asio threads [--pings=N --spin=us --pin=0|1 --payload=N]", runLatencyBenchmark },
+	{ "broadcast", "Bursts of messageAllClients until every client received them [--clients=N --broadcasts=N --burst=N --payload=N]", runBroadcastBenchmark },
+	{ "timers", "Arm, reset and cancel one idle timeout per connection, timing_wheel vs asio::steady_timer [--timers=N]", runTimerBenchmark },
+	{ "fairness", "Quiet clients' ping p50/p99 while one client floods the server, fifo vs fair inbound scheduling, with and without load shedding [--quiet=N --flood=msgs/s --work=us --budget=N --quantum=bytes --target=us --seconds=N]", runFairnessBenchmark },
+	{ "accept", "Connections established per second with one and with --accepts pending accepts [--connections=N --connectors=N --threads=N --accepts=N]", runAcceptBenchmark },
+	{ "clients", "Many clients sharing one client_group: connects, ping rounds and disconnects per second [--clients=N --threads=N --rounds=N]", runClientGroupBenchmark },
+};
+
+int main(int argc, char** argv) {
+	if (argc > 1)
+		for (const benchmark& b : benchmarks)
+			if (std::string(argv[1]) == b.name)
+				return b.run(argc, argv);
+
+	std::cout << "Usage: Benchmark <name> [options]\n";
+	for (const benchmark& b : benchmarks)
+		std::cout << "  " << b.name << "\t" << b.description << "\n";
+	return 1;
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef _NETWORK_BENCHMARKS_
+#define _NETWORK_BENCHMARKS_
+
+#include <net1++.h>
+
+using bench_clock = std::chrono::steady_clock;
+
+// Seconds elapsed since start
+inline double secondsSince(bench_clock::time_point start) {
+	return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// Reads "--name=value" from the command line, or returns fallback
+inline long argOr(int argc, char** argv, const std::string& name, long fallback) {
+	std::string prefix = "--" + name + "=";
+	for (int i = 0; i < argc; i++)
+		if (std::string(argv[i]).rfind(prefix, 0) == 0)
+			return std::stol(std::string(argv[i]).substr(prefix.size()));
+	return fallback;
+}
+
+int runQueueBenchmark(int argc, char** argv);
+int runThroughputBenchmark(int argc, char** argv);
+int runLatencyBenchmark(int argc, char** argv);
+int runBroadcastBenchmark(int argc, char** argv);
+int runTimerBenchmark(int argc, char** argv);
+int runFairnessBenchmark(int argc, char** argv);
+int runAcceptBenchmark(int argc, char** argv);
+int runClientGroupBenchmark(int argc, char** argv);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "benchmarks.h"
+
+using MT = net::message_types;
+
+class broadcast_server : public net::server_interface<MT> {
+public:
+	broadcast_server(uint16_t port)
+		: net::server_interface<MT>(port)
+	{}
+
+protected:
+	bool onClientConnect(net::ref<net::connection<MT>> client) override { return true; }
+};
+
+int runBroadcastBenchmark(int argc, char** argv) {
+	size_t clients = argOr(argc, argv, "clients", 32);
+	size_t broadcasts = argOr(argc, argv, "broadcasts", 20000);
+	size_t burst = argOr(argc, argv, "burst", 64);
+	size_t payload = argOr(argc, argv, "payload", 32);
+	uint16_t port = uint16_t(argOr(argc, argv, "port", 61200));
+
+	broadcast_server server(port);
+	server.start();
+
+	std::vector<net::scope<net::client_interface<MT>>> vecClients;
+	for (size_t i = 0; i < clients; i++) {
+		vecClients.push_back(std::make_unique<net::client_interface<MT>>());
+		vecClients.back()->connect("127.0.0.1", port);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	net::message<MT> msg;
+	msg.getHeader().id = MT::ServerMessage;
+	for (size_t i = 0; i < payload; i++) msg << uint8_t(i);
+	net::shared_message<MT> shared(std::move(msg));
+
+	// Bursts of broadcasts, each burst has to reach every client before the next one goes out
+	std::vector<size_t> received(clients, 0);
+	size_t sent = 0;
+	auto start = bench_clock::now();
+	while (sent < broadcasts && secondsSince(start) < 60) {
+		size_t n = std::min(burst, broadcasts - sent);
+		for (size_t i = 0; i < n; i++) server.messageAllClients(shared);
+		sent += n;
+
+		for (size_t c = 0; c < clients; c++)
+			while (received[c] < sent && secondsSince(start) < 60) {
+				if (vecClients[c]->incoming().empty()) continue;
+				if (vecClients[c]->incoming().pop_front().getMsg().getHeader().id == MT::ServerMessage)
+					received[c]++;
+			}
+	}
+	double seconds = secondsSince(start);
+
+	size_t delivered = 0;
+	for (size_t n : received) delivered += n;
+
+	vecClients.clear();
+	server.stop();
+
+	std::cout << "backend\tclients\tbroadcasts/s\tdeliveries/s\n";
+	std::cout << net::ioBackend() << "\t" << clients << "\t" << size_t(sent / seconds) << "\t\t" << size_t(delivered / seconds) << "\n";
+	return 0;
+}
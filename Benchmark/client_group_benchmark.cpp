@@ -0,0 +1,103 @@
+#include "benchmarks.h"
+
+using MT = net::message_types;
+
+class counting_echo_server : public net::server_interface<MT> {
+public:
+	counting_echo_server(uint16_t port, const net::server_options& options)
+		: net::server_interface<MT>(port, options)
+	{}
+
+	~counting_echo_server() { this->stop(); }
+
+	std::atomic<size_t> nValidated{ 0 };
+
+protected:
+	bool onClientConnect(net::ref<net::connection<MT>> client) override { return true; }
+
+	void onClientValidated(net::ref<net::connection<MT>> client) override { this->nValidated++; }
+
+	void onMessage(net::ref<net::connection<MT>> client, net::message<MT>& msg) override {
+		client->send(std::move(msg));
+	}
+};
+
+// Counts the echoes of its pings on the group's threads.
+class group_client : public net::client_interface<MT> {
+public:
+	group_client(net::client_group& group, std::atomic<size_t>& echoes)
+		: net::client_interface<MT>(group), echoes(echoes)
+	{
+		this->setDispatchMode(net::dispatch_mode::inline_io);
+	}
+
+	~group_client() { this->disconnect(); }
+
+protected:
+	void onMessage(net::message<MT>& msg) override {
+		if (msg.getHeader().id == MT::ServerPing) this->echoes++;
+	}
+
+private:
+	std::atomic<size_t>& echoes;
+};
+
+int runClientGroupBenchmark(int argc, char** argv) {
+	size_t clients = argOr(argc, argv, "clients", 2000);
+	size_t groupThreads = argOr(argc, argv, "threads", 2);
+	size_t rounds = argOr(argc, argv, "rounds", 10);
+	uint16_t port = uint16_t(argOr(argc, argv, "port", 61500));
+
+	net::server_options options;
+	options.dispatchMode = net::dispatch_mode::inline_io;
+
+	// The server and the connections log, keep that out of the results
+	std::streambuf* coutBuffer = std::cout.rdbuf(nullptr);
+
+	size_t validated, echoed;
+	double connectSeconds, pingSeconds, disconnectSeconds;
+	{
+		counting_echo_server server(port, options);
+		server.start();
+
+		net::client_group group(groupThreads);
+		std::atomic<size_t> nEchoes{ 0 };
+		std::vector<net::scope<group_client>> vecClients;
+
+		auto start = bench_clock::now();
+		for (size_t i = 0; i < clients; i++) {
+			vecClients.push_back(std::make_unique<group_client>(group, nEchoes));
+			vecClients.back()->connect("127.0.0.1", port);
+		}
+		while (server.nValidated < clients && secondsSince(start) < 60)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		connectSeconds = secondsSince(start);
+		validated = server.nValidated;
+
+		// Rounds of one ping from every client
+		net::message<MT> ping;
+		ping.getHeader().id = MT::ServerPing;
+		start = bench_clock::now();
+		for (size_t r = 1; r <= rounds; r++) {
+			for (auto& client : vecClients)
+				client->send(ping);
+			while (nEchoes < r * clients && secondsSince(start) < 60)
+				std::this_thread::yield();
+		}
+		pingSeconds = secondsSince(start);
+		echoed = nEchoes;
+
+		start = bench_clock::now();
+		vecClients.clear();
+		disconnectSeconds = secondsSince(start);
+	}
+
+	std::cout.rdbuf(coutBuffer);
+
+	std::cout << "clients\tthreads\tconnects/s\tpings/s\t\tdisconnects/s\n";
+	std::cout << validated << "\t" << groupThreads << "\t"
+		<< size_t(double(validated) / connectSeconds) << "\t\t"
+		<< size_t(double(echoed) / pingSeconds) << "\t\t"
+		<< size_t(double(clients) / disconnectSeconds) << "\n";
+	return 0;
+}
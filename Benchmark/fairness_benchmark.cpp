@@ -0,0 +1,154 @@
+#include "benchmarks.h"
+
+using MT = net::message_types;
+
+// Echoes pings, and burns work microseconds on any other message. Only the other messages
+// may be shed.
+class busy_server : public net::server_interface<MT> {
+public:
+	busy_server(uint16_t port, const net::server_options& options, std::chrono::microseconds work)
+		: net::server_interface<MT>(port, options), work(work)
+	{}
+
+protected:
+	bool onClientConnect(net::ref<net::connection<MT>> client) override { return true; }
+
+	void onMessage(net::ref<net::connection<MT>> client, net::message<MT>& msg) override {
+		if (msg.getHeader().id == MT::ServerPing) {
+			client->send(std::move(msg));
+			return;
+		}
+
+		auto until = bench_clock::now() + this->work;
+		while (bench_clock::now() < until) {}
+	}
+
+	bool canShedMessage(net::ref<net::connection<MT>> client, const net::message<MT>& msg) override {
+		return msg.getHeader().id != MT::ServerPing;
+	}
+
+private:
+	std::chrono::microseconds work;
+};
+
+// Keeps one ping in flight until stopped, sending the next one from its asio thread.
+class quiet_client : public net::client_interface<MT> {
+public:
+	quiet_client() {
+		this->request.getHeader().id = MT::ServerPing;
+		this->setDispatchMode(net::dispatch_mode::inline_io);
+	}
+
+	void ping() {
+		this->sent = bench_clock::now();
+		this->send(this->request);
+	}
+
+	std::vector<double> vecSamples;		// Round trip times in microseconds
+	std::atomic<bool> stopped{ false };
+
+protected:
+	void onMessage(net::message<MT>& msg) override {
+		if (msg.getHeader().id != MT::ServerPing) return;
+
+		this->vecSamples.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - this->sent).count());
+		if (!this->stopped)
+			this->ping();
+	}
+
+private:
+	net::message<MT> request;
+	bench_clock::time_point sent;
+};
+
+static double percentile(const std::vector<double>& sorted, double p) {
+	return sorted[size_t(p * double(sorted.size() - 1))];
+}
+
+// One client floods the server faster than onMessage keeps up while the quiet clients ping it,
+// prints the round trip percentiles of the quiet clients and the flood messages shed.
+static void measure(const char* name, net::inbound_scheduling scheduling, std::chrono::microseconds target, uint16_t port, size_t quiet,
+	size_t floodRate, std::chrono::microseconds work, size_t budget, size_t quantum, std::chrono::seconds duration) {
+	net::server_options options;
+	options.inboundScheduling = scheduling;
+	options.fairQuantum = quantum;
+	options.sheddingTarget = target;
+
+	busy_server server(port, options, work);
+	server.start();
+
+	std::atomic<bool> running{ true };
+	std::thread updater([&]() {
+		while (running) {
+			server.update(budget);
+			std::this_thread::yield();
+		}
+	});
+
+	net::client_interface<MT> flooder;
+	flooder.connect("127.0.0.1", port);
+	std::vector<net::scope<quiet_client>> vecQuiet;
+	for (size_t i = 0; i < quiet; i++) {
+		vecQuiet.push_back(std::make_unique<quiet_client>());
+		vecQuiet.back()->connect("127.0.0.1", port);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	for (auto& client : vecQuiet)
+		client->ping();
+
+	// Paced in steps of a millisecond
+	net::message<MT> flood;
+	flood.getHeader().id = MT::ServerMessage;
+	for (size_t i = 0; i < 32; i++) flood << uint8_t(i);
+	size_t floodSent = 0;
+	auto start = bench_clock::now();
+	while (bench_clock::now() - start < duration) {
+		size_t due = size_t(secondsSince(start) * double(floodRate));
+		for (; floodSent < due; floodSent++)
+			flooder.send(flood);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	for (auto& client : vecQuiet)
+		client->stopped = true;
+	for (auto& client : vecQuiet)
+		client->disconnect();
+	flooder.disconnect();
+	running = false;
+	updater.join();
+	server.stop();
+
+	std::vector<double> samples;
+	for (auto& client : vecQuiet)
+		samples.insert(samples.end(), client->vecSamples.begin(), client->vecSamples.end());
+	if (samples.empty()) {
+		std::cout << name << "\tno round trips completed\n";
+		return;
+	}
+	std::sort(samples.begin(), samples.end());
+	std::cout << name << "\t"
+		<< samples.size() << "\t"
+		<< percentile(samples, 0.50) << "\t"
+		<< percentile(samples, 0.99) << "\t"
+		<< server.getShedMessages(MT::ServerMessage) << "/" << floodSent << "\n";
+}
+
+int runFairnessBenchmark(int argc, char** argv) {
+	size_t quiet = argOr(argc, argv, "quiet", 4);
+	size_t floodRate = argOr(argc, argv, "flood", 40000);
+	std::chrono::microseconds work(argOr(argc, argv, "work", 50));
+	size_t budget = argOr(argc, argv, "budget", 64);
+	size_t quantum = argOr(argc, argv, "quantum", 4096);
+	std::chrono::seconds duration(argOr(argc, argv, "seconds", 3));
+	std::chrono::microseconds target(argOr(argc, argv, "target", 5000));
+	uint16_t port = uint16_t(argOr(argc, argv, "port", 61300));
+	std::chrono::microseconds none(0);
+
+	std::cout << "sched\t\tpings\tp50 us\tp99 us\tshed/flood\n";
+	measure("fifo\t", net::inbound_scheduling::fifo, none, port, quiet, floodRate, work, budget, quantum, duration);
+	measure("fair\t", net::inbound_scheduling::fair, none, uint16_t(port + 1), quiet, floodRate, work, budget, quantum, duration);
+	measure("fifo+codel", net::inbound_scheduling::fifo, target, uint16_t(port + 2), quiet, floodRate, work, budget, quantum, duration);
+	measure("fair+codel", net::inbound_scheduling::fair, target, uint16_t(port + 3), quiet, floodRate, work, budget, quantum, duration);
+	return 0;
+}
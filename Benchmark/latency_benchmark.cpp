@@ -0,0 +1,106 @@
+#include "benchmarks.h"
+
+using MT = net::message_types;
+
+class inline_echo_server : public net::server_interface<MT> {
+public:
+	inline_echo_server(uint16_t port, const net::server_options& options)
+		: net::server_interface<MT>(port, options)
+	{}
+
+protected:
+	bool onClientConnect(net::ref<net::connection<MT>> client) override { return true; }
+
+	void onMessage(net::ref<net::connection<MT>> client, net::message<MT>& msg) override {
+		client->send(std::move(msg));
+	}
+};
+
+// Sends the next ping from its asio thread as soon as the previous one came back.
+class ping_client : public net::client_interface<MT> {
+public:
+	ping_client(size_t pings, size_t payload) : nPings(pings) {
+		this->request.getHeader().id = MT::ServerPing;
+		for (size_t i = 0; i < payload; i++) this->request << uint8_t(i);
+		this->vecSamples.reserve(pings);
+		this->setDispatchMode(net::dispatch_mode::inline_io);
+	}
+
+	void ping() {
+		this->sent = bench_clock::now();
+		this->send(this->request);
+	}
+
+	std::vector<double> vecSamples;		// Round trip times in microseconds
+	std::atomic<bool> done{ false };
+
+protected:
+	void onMessage(net::message<MT>& msg) override {
+		if (msg.getHeader().id != MT::ServerPing) return;
+
+		this->vecSamples.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - this->sent).count());
+		if (this->vecSamples.size() < this->nPings)
+			this->ping();
+		else
+			this->done = true;
+	}
+
+private:
+	net::message<MT> request;
+	bench_clock::time_point sent;
+	size_t nPings;
+};
+
+static double percentile(const std::vector<double>& sorted, double p) {
+	return sorted[size_t(p * double(sorted.size() - 1))];
+}
+
+// One ping in flight at a time, prints round trip percentiles after dropping the warmup.
+static void measure(const char* name, uint16_t port, std::chrono::microseconds spin, bool pin, size_t pings, size_t warmup, size_t payload) {
+	net::server_options options;
+	options.dispatchMode = net::dispatch_mode::inline_io;
+	options.busyPoll = spin;
+	options.pinThreads = pin;
+
+	inline_echo_server server(port, options);
+	server.start();
+
+	ping_client client(warmup + pings, payload);
+	client.setRunMode(spin, pin ? 1 : -1);
+	client.connect("127.0.0.1", port);
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	client.ping();
+	auto start = bench_clock::now();
+	while (!client.done && secondsSince(start) < 60)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	client.disconnect();
+	server.stop();
+
+	std::vector<double> samples(client.vecSamples.begin() + std::min(warmup, client.vecSamples.size()), client.vecSamples.end());
+	if (samples.empty()) {
+		std::cout << name << "\tno round trips completed\n";
+		return;
+	}
+	std::sort(samples.begin(), samples.end());
+	std::cout << name << "\t"
+		<< samples.size() << "\t"
+		<< percentile(samples, 0.50) << "\t"
+		<< percentile(samples, 0.99) << "\t"
+		<< percentile(samples, 0.999) << "\n";
+}
+
+int runLatencyBenchmark(int argc, char** argv) {
+	size_t pings = argOr(argc, argv, "pings", 20000);
+	size_t payload = argOr(argc, argv, "payload", 32);
+	std::chrono::microseconds spin(argOr(argc, argv, "spin", 200));
+	bool pin = argOr(argc, argv, "pin", 0) != 0;
+	uint16_t port = uint16_t(argOr(argc, argv, "port", 61100));
+	size_t warmup = pings / 10;
+
+	std::cout << "mode\tpings\tp50 us\tp99 us\tp99.9 us\n";
+	measure("blocking", port, std::chrono::microseconds(0), pin, pings, warmup, payload);
+	measure("busy-poll", uint16_t(port + 1), spin, pin, pings, warmup, payload);
+	return 0;
+}
@@ -0,0 +1,48 @@
+#include "benchmarks.h"
+
+using bench_message = net::owned_message<net::message_types>;
+
+// P producer threads push items messages each while one consumer drains them,
+// the way connections feed the server's qMessagesIn and update() drains it.
+template <typename Queue>
+static double pushPopRate(size_t producers, size_t items) {
+	Queue queue;
+	std::atomic<bool> go{ false };
+	std::vector<std::thread> threads;
+
+	for (size_t p = 0; p < producers; p++)
+		threads.emplace_back([&]() {
+			while (!go) std::this_thread::yield();
+			for (size_t i = 0; i < items; i++) {
+				net::message<net::message_types> msg;
+				msg << uint32_t(i);
+				queue.push_back(bench_message(std::move(msg)));
+			}
+		});
+
+	auto start = bench_clock::now();
+	go = true;
+
+	size_t total = producers * items;
+	for (size_t received = 0; received < total; received++) {
+		queue.wait();
+		queue.pop_front();
+	}
+
+	double seconds = secondsSince(start);
+	for (auto& t : threads) t.join();
+	return total / seconds;
+}
+
+int runQueueBenchmark(int argc, char** argv) {
+	size_t items = argOr(argc, argv, "items", 1000000);
+	size_t maxProducers = argOr(argc, argv, "max-producers", std::max(2u, std::thread::hardware_concurrency()));
+
+	std::cout << "producers\ttsqueue Mmsg/s\tmpsc_queue Mmsg/s\n";
+	for (size_t producers = 1; producers <= maxProducers; producers *= 2) {
+		double locked = pushPopRate<net::tsqueue<bench_message>>(producers, items);
+		double lockfree = pushPopRate<net::mpsc_queue<bench_message>>(producers, items);
+		std::cout << producers << "\t\t" << locked / 1e6 << "\t\t" << lockfree / 1e6 << "\n";
+	}
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "benchmarks.h"
+
+using MT = net::message_types;
+
+class echo_server : public net::server_interface<MT> {
+public:
+	echo_server(uint16_t port, const net::server_options& options)
+		: net::server_interface<MT>(port, options)
+	{}
+
+protected:
+	bool onClientConnect(net::ref<net::connection<MT>> client) override { return true; }
+
+	void onMessage(net::ref<net::connection<MT>> client, net::message<MT>& msg) override {
+		client->send(std::move(msg));
+	}
+};
+
+// Every client keeps window echo requests in flight for the given time, returns round trips per second.
+static double echoRate(uint16_t port, const net::server_options& options, size_t clients, size_t window, size_t payload, double seconds) {
+	echo_server server(port, options);
+	server.start();
+
+	std::atomic<bool> running{ true };
+	std::thread updater([&]() {
+		while (running) {
+			server.update(-1, false);
+			std::this_thread::yield();
+		}
+	});
+
+	std::vector<net::scope<net::client_interface<MT>>> vecClients;
+	for (size_t i = 0; i < clients; i++) {
+		vecClients.push_back(std::make_unique<net::client_interface<MT>>());
+		vecClients.back()->connect("127.0.0.1", port);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	net::message<MT> request;
+	request.getHeader().id = MT::ServerPing;
+	for (size_t i = 0; i < payload; i++) request << uint8_t(i);
+
+	for (auto& client : vecClients)
+		for (size_t i = 0; i < window; i++) client->send(request);
+
+	size_t roundTrips = 0;
+	auto start = bench_clock::now();
+	while (secondsSince(start) < seconds) {
+		for (auto& client : vecClients)
+			while (!client->incoming().empty()) {
+				client->incoming().pop_front();
+				client->send(request);
+				roundTrips++;
+			}
+	}
+	double rate = roundTrips / secondsSince(start);
+
+	vecClients.clear();
+	running = false;
+	updater.join();
+	server.stop();
+	return rate;
+}
+
+int runThroughputBenchmark(int argc, char** argv) {
+	size_t maxThreads = argOr(argc, argv, "max-threads", std::max(1u, std::thread::hardware_concurrency()));
+	size_t clients = argOr(argc, argv, "clients", 32);
+	size_t window = argOr(argc, argv, "window", 16);
+	size_t payload = argOr(argc, argv, "payload", 32);
+	double seconds = double(argOr(argc, argv, "seconds", 3));
+	uint16_t port = uint16_t(argOr(argc, argv, "port", 61000));
+	bool sharded = argOr(argc, argv, "sharded", 0) != 0;
+
+	std::vector<std::pair<size_t, double>> results;
+	for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+		net::server_options options;
+		options.ioThreads = sharded ? 1 : threads;
+		options.shards = sharded ? threads : 1;
+		options.pinThreads = sharded;
+		results.emplace_back(threads, echoRate(port++, options, clients, window, payload, seconds));
+	}
+
+	std::cout << "backend: " << net::ioBackend() << "\n";
+	std::cout << (sharded ? "shards" : "io threads") << "\tround trips/s\tscaling\n";
+	for (auto& [threads, rate] : results)
+		std::cout << threads << "\t\t" << size_t(rate) << "\t\t" << rate / results.front().second << "x\n";
+	return 0;
+}
\ No newline at end of file
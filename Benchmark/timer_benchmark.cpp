@@ -0,0 +1,62 @@
+#include "benchmarks.h"
+
+// Nanoseconds per operation of fn over count operations
+template <typename F>
+static double nsPerOp(size_t count, F&& fn) {
+	auto start = bench_clock::now();
+	fn();
+	return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / double(count);
+}
+
+int runTimerBenchmark(int argc, char** argv) {
+	size_t timers = argOr(argc, argv, "timers", 100000);
+	std::chrono::seconds timeout(30);
+
+	// One idle timeout per connection: arm it, push it back as if traffic arrived, then cancel it
+	double wheelArm, wheelReset, wheelCancel;
+	{
+		net::timing_wheel wheel;
+		std::vector<net::slot_key> keys(timers);
+
+		wheelArm = nsPerOp(timers, [&]() {
+			for (size_t i = 0; i < timers; i++) keys[i] = wheel.schedule(timeout, []() {});
+		});
+		wheelReset = nsPerOp(timers, [&]() {
+			for (size_t i = 0; i < timers; i++) wheel.reschedule(keys[i], timeout);
+		});
+		wheelCancel = nsPerOp(timers, [&]() {
+			for (size_t i = 0; i < timers; i++) wheel.cancel(keys[i]);
+		});
+	}
+
+	double asioArm, asioReset, asioCancel;
+	{
+		asio::io_context context;
+		std::vector<asio::steady_timer> vecTimers;
+		vecTimers.reserve(timers);
+		for (size_t i = 0; i < timers; i++) vecTimers.emplace_back(context);
+
+		asioArm = nsPerOp(timers, [&]() {
+			for (auto& timer : vecTimers) {
+				timer.expires_after(timeout);
+				timer.async_wait([](std::error_code) {});
+			}
+		});
+		asioReset = nsPerOp(timers, [&]() {
+			for (auto& timer : vecTimers) {
+				timer.expires_after(timeout);
+				timer.async_wait([](std::error_code) {});
+			}
+		});
+		asioCancel = nsPerOp(timers, [&]() {
+			for (auto& timer : vecTimers) timer.cancel();
+		});
+		context.run();
+	}
+
+	std::cout << timers << " timers, ns per operation\n";
+	std::cout << "\t\tarm\treset\tcancel\n";
+	std::cout << "timing_wheel\t" << wheelArm << "\t" << wheelReset << "\t" << wheelCancel << "\n";
+	std::cout << "steady_timer\t" << asioArm << "\t" << asioReset << "\t" << asioCancel << "\n";
+	return 0;
+}
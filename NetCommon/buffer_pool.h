@@ -0,0 +1,347 @@
+/*
+ * NetWeave - C++ Networking Library
+ * Copyright 2024 - Jessy van Polanen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NETWORK_BUFFER_POOL_
+#define _NETWORK_BUFFER_POOL_
+
+#include "net_common.h"
+
+BEGIN_NET_NS
+
+/// <summary>
+/// Size classed pool of raw memory blocks, used for message bodies.
+/// Block sizes are powers of two from minBlockSize up to maxBlockSize, larger requests
+/// bypass the pool. Every thread owns a cache (see local()), acquire and release only lock
+/// the shared depot when a cache moves a batch of blocks. Messages are usually allocated on
+/// the asio thread and freed on the thread calling update(), so caches that grow too large
+/// hand a batch of blocks to the depot, and caches that run dry take a batch back from it.
+/// Every pool counts for itself, getTotalStats() sums the counters of all of them.
+/// </summary>
+class buffer_pool {
+public:
+	static constexpr size_t minBlockSize = 64;
+	static constexpr size_t sizeClasses = 11;
+	static constexpr size_t maxBlockSize = minBlockSize << (sizeClasses - 1);
+
+	static constexpr size_t transferBatch = 32;				// Blocks moved between a cache and the depot at once
+	static constexpr size_t maxCachedBlocks = 4 * transferBatch;	// Per size class, per thread
+	static constexpr size_t maxDepotBlocks = 64 * transferBatch;	// Per size class, shared by all threads
+
+	struct stats {
+		uint64_t hits = 0;			// Acquires served from the pool
+		uint64_t misses = 0;		// Acquires that had to allocate
+		uint64_t oversized = 0;		// Acquires larger than maxBlockSize, never pooled
+		uint64_t releases = 0;		// Blocks returned to the pool
+		uint64_t discards = 0;		// Blocks freed because the depot was full
+	};
+
+public:
+	buffer_pool() {
+		registry& r = sharedRegistry();
+		std::scoped_lock<std::mutex> lock(r.mux);
+		r.pools.push_back(this);
+	}
+
+	buffer_pool(const buffer_pool&) = delete;
+
+	virtual ~buffer_pool() {
+		for (size_t c = 0; c < sizeClasses; c++)
+			this->returnToDepot(c, this->freeBlocks[c].size());
+		if (this == local())
+			localDestroyed() = true;
+
+		// The counts of a destroyed pool stay in the totals
+		registry& r = sharedRegistry();
+		std::scoped_lock<std::mutex> lock(r.mux);
+		r.pools.erase(std::find(r.pools.begin(), r.pools.end(), this));
+		addStats(r.retired, this->getStats());
+	}
+
+public:
+	/// <summary>
+	/// Returns the pool of the calling thread. Null once the thread is exiting and its pool
+	/// was destroyed, while the destructors of other thread locals may still free messages.
+	/// </summary>
+	/// <returns></returns>
+	static buffer_pool* local() {
+		if (localDestroyed()) return nullptr;
+		thread_local buffer_pool pool;
+		return &pool;
+	}
+
+	/// <summary>
+	/// acquire() on the calling thread's pool, or a plain allocation once that is destroyed.
+	/// </summary>
+	/// <param name="size"></param>
+	/// <returns></returns>
+	static uint8_t* acquireLocal(size_t size) {
+		if (buffer_pool* pool = local())
+			return pool->acquire(size);
+		countRetired(size > maxBlockSize ? &stats::oversized : &stats::misses);
+		return static_cast<uint8_t*>(::operator new(blockSize(size)));
+	}
+
+	/// <summary>
+	/// release() on the calling thread's pool, or straight to the depot once that is destroyed.
+	/// </summary>
+	/// <param name="block"></param>
+	/// <param name="size"></param>
+	static void releaseLocal(uint8_t* block, size_t size) {
+		if (buffer_pool* pool = local()) {
+			pool->release(block, size);
+			return;
+		}
+		if (block == nullptr) return;
+		if (size > maxBlockSize) {
+			::operator delete(block);
+			return;
+		}
+
+		countRetired(&stats::releases);
+		{
+			depot& d = sharedDepot();
+			std::scoped_lock<std::mutex> lock(d.mux);
+			std::vector<uint8_t*>& to = d.blocks[sizeClass(size)];
+			if (to.size() < maxDepotBlocks) {
+				to.push_back(block);
+				return;
+			}
+		}
+		countRetired(&stats::discards);
+		::operator delete(block);
+	}
+
+	/// <summary>
+	/// Returns the size of the block that is handed out for a request of size bytes.
+	/// </summary>
+	/// <param name="size"></param>
+	/// <returns>Block size in bytes</returns>
+	static size_t blockSize(size_t size) {
+		if (size > maxBlockSize) return size;
+		return minBlockSize << sizeClass(size);
+	}
+
+	/// <summary>
+	/// Takes a block of at least size bytes from the pool.
+	/// </summary>
+	/// <param name="size"></param>
+	/// <returns>Block aligned for any fundamental type</returns>
+	uint8_t* acquire(size_t size) {
+		if (size > maxBlockSize) {
+			bump(this->counters.oversized);
+			return static_cast<uint8_t*>(::operator new(size));
+		}
+
+		size_t c = sizeClass(size);
+		std::vector<uint8_t*>& blocks = this->freeBlocks[c];
+		if (blocks.empty())
+			this->takeFromDepot(c);
+
+		if (blocks.empty()) {
+			bump(this->counters.misses);
+			return static_cast<uint8_t*>(::operator new(minBlockSize << c));
+		}
+
+		bump(this->counters.hits);
+		uint8_t* block = blocks.back();
+		blocks.pop_back();
+		return block;
+	}
+
+	/// <summary>
+	/// Hands a block back to the pool, size must be the size it was acquired with.
+	/// </summary>
+	/// <param name="block"></param>
+	/// <param name="size"></param>
+	void release(uint8_t* block, size_t size) {
+		if (block == nullptr) return;
+		if (size > maxBlockSize) {
+			::operator delete(block);
+			return;
+		}
+
+		size_t c = sizeClass(size);
+		std::vector<uint8_t*>& blocks = this->freeBlocks[c];
+		bump(this->counters.releases);
+		blocks.push_back(block);
+
+		if (blocks.size() >= maxCachedBlocks)
+			this->returnToDepot(c, transferBatch);
+	}
+
+	/// <summary>
+	/// Counters of this pool.
+	/// </summary>
+	/// <returns></returns>
+	stats getStats() const {
+		stats result;
+		result.hits = this->counters.hits.load(std::memory_order_relaxed);
+		result.misses = this->counters.misses.load(std::memory_order_relaxed);
+		result.oversized = this->counters.oversized.load(std::memory_order_relaxed);
+		result.releases = this->counters.releases.load(std::memory_order_relaxed);
+		result.discards = this->counters.discards.load(std::memory_order_relaxed);
+		return result;
+	}
+
+	/// <summary>
+	/// Counters of all pools, including the ones that were destroyed with their threads.
+	/// The pools keep counting meanwhile, so the sum is not an exact snapshot.
+	/// </summary>
+	/// <returns></returns>
+	static stats getTotalStats() {
+		registry& r = sharedRegistry();
+		std::scoped_lock<std::mutex> lock(r.mux);
+
+		stats total = r.retired;
+		for (buffer_pool* pool : r.pools)
+			addStats(total, pool->getStats());
+		return total;
+	}
+
+private:
+	struct depot {
+		std::mutex mux;
+		std::vector<uint8_t*> blocks[sizeClasses];
+
+		~depot() {
+			for (auto& list : this->blocks)
+				for (uint8_t* block : list) ::operator delete(block);
+		}
+	};
+
+	// Written by the owning thread only, atomic so getTotalStats can read them from any thread
+	struct counters_t {
+		std::atomic<uint64_t> hits{ 0 };
+		std::atomic<uint64_t> misses{ 0 };
+		std::atomic<uint64_t> oversized{ 0 };
+		std::atomic<uint64_t> releases{ 0 };
+		std::atomic<uint64_t> discards{ 0 };
+	};
+
+	struct registry {
+		std::mutex mux;
+		std::vector<buffer_pool*> pools;	// Live pools
+		stats retired;						// Destroyed pools, and allocations after the thread's pool was destroyed
+	};
+
+	static depot& sharedDepot() {
+		static depot d;
+		return d;
+	}
+
+	static registry& sharedRegistry() {
+		static registry r;
+		return r;
+	}
+
+	// A plain load and store, no other thread writes the counter
+	static void bump(std::atomic<uint64_t>& counter) {
+		counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	static void countRetired(uint64_t stats::* counter) {
+		registry& r = sharedRegistry();
+		std::scoped_lock<std::mutex> lock(r.mux);
+		r.retired.*counter += 1;
+	}
+
+	static void addStats(stats& to, const stats& from) {
+		to.hits += from.hits;
+		to.misses += from.misses;
+		to.oversized += from.oversized;
+		to.releases += from.releases;
+		to.discards += from.discards;
+	}
+
+	// Outlives the thread's pool, a bool needs no destructor
+	static bool& localDestroyed() {
+		thread_local bool destroyed = false;
+		return destroyed;
+	}
+
+	static size_t sizeClass(size_t size) {
+		size_t c = 0;
+		while ((minBlockSize << c) < size) c++;
+		return c;
+	}
+
+	void takeFromDepot(size_t c) {
+		depot& d = sharedDepot();
+		std::scoped_lock<std::mutex> lock(d.mux);
+
+		std::vector<uint8_t*>& from = d.blocks[c];
+		size_t n = std::min(transferBatch, from.size());
+		this->freeBlocks[c].insert(this->freeBlocks[c].end(), from.end() - n, from.end());
+		from.resize(from.size() - n);
+	}
+
+	void returnToDepot(size_t c, size_t n) {
+		std::vector<uint8_t*>& blocks = this->freeBlocks[c];
+		n = std::min(n, blocks.size());
+
+		depot& d = sharedDepot();
+		std::scoped_lock<std::mutex> lock(d.mux);
+
+		std::vector<uint8_t*>& to = d.blocks[c];
+		while (n > 0) {
+			uint8_t* block = blocks.back();
+			blocks.pop_back();
+			n--;
+
+			if (to.size() < maxDepotBlocks)
+				to.push_back(block);
+			else {
+				bump(this->counters.discards);
+				::operator delete(block);
+			}
+		}
+	}
+
+private:
+	std::vector<uint8_t*> freeBlocks[sizeClasses];
+	counters_t counters;
+};
+
+/// <summary>
+/// Standard allocator that takes its memory from the calling thread's buffer_pool.
+/// </summary>
+/// <typeparam name="T"></typeparam>
+template <typename T>
+struct pool_allocator {
+	using value_type = T;
+
+	pool_allocator() = default;
+	template <typename U>
+	pool_allocator(const pool_allocator<U>&) {}
+
+	T* allocate(size_t n) {
+		return reinterpret_cast<T*>(buffer_pool::acquireLocal(n * sizeof(T)));
+	}
+
+	void deallocate(T* p, size_t n) {
+		buffer_pool::releaseLocal(reinterpret_cast<uint8_t*>(p), n * sizeof(T));
+	}
+
+	template <typename U>
+	bool operator == (const pool_allocator<U>&) const { return true; }
+	template <typename U>
+	bool operator != (const pool_allocator<U>&) const { return false; }
+};
+
+END_NET_NS
+
+#endif
\ No newline at end of file
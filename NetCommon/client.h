@@ -23,13 +23,26 @@
 #include "message.h"
 #include "tsqueue.h"
 #include "connection.h"
+#include "client_group.h"
 
 BEGIN_NET_NS 
 
 template <typename T>
 class client_interface {
 public:
-	client_interface() : socket(context) {}
+	client_interface() : context(std::in_place), ioContext(*context), socket(*context) {}
+
+	/// <summary>
+	/// Client that runs on the asio context of a group instead of a context and thread of its
+	/// own. The group has to outlive the client.
+	/// </summary>
+	/// <param name="group"></param>
+	client_interface(client_group& group) : group(&group), ioContext(group.getContext()), socket(group.getContext()) {}
+
+	/// <summary>
+	/// A derived client that overrides onMessage in inline_io dispatch mode has to call
+	/// disconnect() in its own destructor, the asio threads can still call onMessage until then.
+	/// </summary>
 	virtual ~client_interface() { this->disconnect(); }
 public:
 	/// <summary>
@@ -40,17 +53,26 @@ public:
 	/// <returns></returns>
 	bool connect(const std::string& host, const uint16_t port) {
 		try {
-			asio::ip::tcp::resolver resolver(this->context);
+			asio::ip::tcp::resolver resolver(this->ioContext);
 			asio::ip::tcp::resolver::results_type endpoints = resolver.resolve(host, std::to_string(port));
 
-			this->conn = std::make_unique<connection<T>>(
+			this->conn = std::make_shared<connection<T>>(
 				connection<T>::owner::client,
-				this->context,
-				asio::ip::tcp::socket(this->context),
-				this->qMessagesIn); 
+				this->ioContext,
+				asio::ip::tcp::socket(this->ioContext),
+				this->qMessagesIn,
+				this->connOptions); 
+			this->conn->setSharedContext(this->group != nullptr);
+
+			if (this->dispatchMode == dispatch_mode::inline_io)
+				this->conn->setMessageHandler([this](message<T>& msg) { onMessage(msg); });
 
 			this->conn->connectToServer(endpoints);
-			this->threadContext = std::thread([this]() { context.run(); });
+			if (this->group) return true;
+
+			this->threadContext = std::thread([this]() { runContext(*context, busyPoll); });
+			if (this->pinCore >= 0)
+				pinThreadToCore(this->threadContext, size_t(this->pinCore));
 		}
 		catch (std::exception& e) {
 			std::cerr << "[Client Exception] " << e.what() << "\n";
@@ -61,16 +83,38 @@ public:
 	}
 
 	/// <summary>
-	/// Disconnect from the server.
+	/// Disconnect from the server. A client on a group waits until the handlers of its connection
+	/// are done with it, unless it is called from one of the group's threads, so do not destroy
+	/// a client from its own onMessage.
 	/// </summary>
 	void disconnect() {
+		if (this->group) {
+			if (!this->conn) return;
+
+			// The last handler of the connection lets go of it on a group thread
+			bool wait = !this->ioContext.get_executor().running_in_this_thread();
+			auto released = std::make_shared<std::promise<void>>();
+			std::future<void> done = released->get_future();
+			if (wait)
+				this->conn->setDestroyHandler([released]() { released->set_value(); });
+
+			if (this->isConnected())
+				this->conn->disconnect();
+			this->conn.reset();
+
+			// A stopped context never runs the handlers, they are destroyed with it
+			if (wait)
+				while (done.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready && !this->ioContext.stopped()) {}
+			return;
+		}
+
 		if (this->isConnected())
 			this->conn->disconnect();
 
-		this->context.stop();
+		this->context->stop();
 		if (this->threadContext.joinable()) threadContext.join();
 
-		this->conn.release();
+		this->conn.reset();
 	}
 
 	/// <summary>
@@ -88,23 +132,78 @@ public:
 	/// </summary>
 	/// <param name="msg"></param>
 	/// <returns></returns>
-	void send(const message<T>& msg) {
+	send_status send(const message<T>& msg) {
+		if (this->isConnected())
+			return this->conn->send(msg);
+		return send_status::disconnected;
+	}
+
+	/// <summary>
+	/// Sends a message object through the connection, the body is moved without a copy.
+	/// </summary>
+	/// <param name="msg"></param>
+	/// <returns></returns>
+	send_status send(message<T>&& msg) {
 		if (this->isConnected())
-			this->conn->send(msg);
+			return this->conn->send(std::move(msg));
+		return send_status::disconnected;
+	}
+
+	/// <summary>
+	/// Sets the options used by the connection, call before connecting.
+	/// </summary>
+	/// <param name="options"></param>
+	void setConnectionOptions(const connection_options& options) {
+		this->connOptions = options;
+	}
+
+	/// <summary>
+	/// Sets how received messages are delivered, call before connecting. In inline_io mode
+	/// onMessage is called on the asio thread and incoming() stays empty, the other modes
+	/// deliver through incoming().
+	/// </summary>
+	/// <param name="mode"></param>
+	void setDispatchMode(dispatch_mode mode) {
+		this->dispatchMode = mode;
+	}
+
+	/// <summary>
+	/// Low latency run mode, call before connecting. The asio thread spins for busyPoll
+	/// without work before it blocks (see runContext) and is pinned to pinCore if not negative.
+	/// Not used on a group, which has its own run mode.
+	/// </summary>
+	/// <param name="busyPoll"></param>
+	/// <param name="pinCore"></param>
+	void setRunMode(std::chrono::microseconds busyPoll, int pinCore = -1) {
+		this->busyPoll = busyPoll;
+		this->pinCore = pinCore;
 	}
 
 public:
-	inline tsqueue<owned_message<T>>& incoming() {
+	inline inbound_queue<owned_message<T>>& incoming() {
 		return this->qMessagesIn;
 	}
 
 protected:
-	asio::io_context context;					// asio context handles the data transfer ...
+	/// <summary>
+	/// Called on the asio thread for every message in inline_io dispatch mode.
+	/// </summary>
+	/// <param name="msg"></param>
+	virtual void onMessage(message<T>& msg) {}
+
+protected:
+	std::optional<asio::io_context> context;	// asio context handles the data transfer, only without a group ...
 	std::thread threadContext;					// asio context also needs athread of it's own to execute commands
+	client_group* group = nullptr;				// Group whose context runs the client instead, null if it runs its own
+	asio::io_context& ioContext;				// The context the connection runs on, the own one or the group's
 	asio::ip::tcp::socket socket;				// This is the hardware socket connected to the server
-	scope<connection<T>> conn;		// The client has a single instance of a "connection" object, which handles data transfer
+	ref<connection<T>> conn;		// The client has a single instance of a "connection" object, which handles data transfer
+	connection_options connOptions;				// Handed to the connection when connecting
+	dispatch_mode dispatchMode = dispatch_mode::serial;
+	std::chrono::microseconds busyPoll{ 0 };	// See setRunMode
+	int pinCore = -1;
 private:
-	tsqueue<owned_message<T>> qMessagesIn;		// This is the thread safe queue of incoming messages from the server
+	inbound_queue<owned_message<T>> qMessagesIn;		// This is the thread safe queue of incoming messages from the server
 };
 
 END_NET_NS
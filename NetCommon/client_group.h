@@ -0,0 +1,72 @@
+/*
+ * NetWeave - C++ Networking Library
+ * Copyright 2024 - Jessy van Polanen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NETWORK_CLIENT_GROUP_
+#define _NETWORK_CLIENT_GROUP_
+
+#include "net_common.h"
+
+BEGIN_NET_NS
+
+/// <summary>
+/// One asio context and a small pool of threads running it, shared by any number of clients
+/// instead of every client running a context and a thread of its own. Every client keeps its
+/// own connection, strand and incoming queue. The threads start on construction and stop
+/// when the group is destroyed, which has to happen after its clients are destroyed.
+/// </summary>
+class client_group {
+public:
+	/// <summary>
+	/// Starts the threads of the group.
+	/// </summary>
+	/// <param name="threads">0 uses one per core</param>
+	/// <param name="busyPoll">Threads spin this long without work before they block, see runContext</param>
+	/// <param name="pinThreads">Pin every thread to its own core</param>
+	client_group(size_t threads = 1, std::chrono::microseconds busyPoll = std::chrono::microseconds(0), bool pinThreads = false) {
+		if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+		for (size_t i = 0; i < threads; i++) {
+			this->vecThreads.emplace_back([this, busyPoll]() { runContext(this->context, busyPoll); });
+			if (pinThreads)
+				pinThreadToCore(this->vecThreads.back(), i);
+		}
+	}
+
+	client_group(const client_group&) = delete;
+
+	~client_group() {
+		this->work.reset();
+		this->context.stop();
+		for (std::thread& thread : this->vecThreads)
+			if (thread.joinable()) thread.join();
+	}
+
+public:
+	inline asio::io_context& getContext() { return this->context; }
+	inline size_t getThreads() const { return this->vecThreads.size(); }
+
+private:
+	asio::io_context context;
+	asio::executor_work_guard<asio::io_context::executor_type> work = asio::make_work_guard(context);	// Keeps the threads running while no client is connected
+	std::vector<std::thread> vecThreads;
+public:
+	client_group& operator = (const client_group&) = delete;
+};
+
+END_NET_NS
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * NetWeave - C++ Networking Library
+ * Copyright 2024 - Jessy van Polanen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NETWORK_CODEL_
+#define _NETWORK_CODEL_
+
+#include "net_common.h"
+
+BEGIN_NET_NS
+
+/// <summary>
+/// CoDel style queue management for a queue of requests. Looks at how long every message
+/// leaving the queue spent in it. When messages keep leaving later than target for a whole
+/// interval the queue has a standing backlog instead of a burst, and from then on every
+/// message that waited longer than target is dropped, until one leaves below target again.
+/// Outside of that only messages that waited longer than the interval are dropped.
+/// Unlike CoDel for packets (RFC 8289) it does not wait for senders to slow down after a drop,
+/// the senders of messages rarely do, it keeps the wait at about target while overloaded.
+/// A target of zero disables it. Not thread safe.
+/// </summary>
+class codel {
+public:
+	using clock = std::chrono::steady_clock;
+
+public:
+	codel() = default;
+
+	codel(clock::duration target, clock::duration interval)
+		: target(target), interval(std::max(interval, target))
+	{}
+
+public:
+	inline bool enabled() const { return this->target > clock::duration::zero(); }
+	inline bool isOverloaded() const { return this->overloaded; }
+
+	/// <summary>
+	/// Feeds the time a message spent in the queue as it leaves.
+	/// </summary>
+	/// <param name="sojourn"></param>
+	/// <param name="now"></param>
+	/// <returns>Whether the message should be dropped</returns>
+	bool shouldDrop(clock::duration sojourn, clock::time_point now = clock::now()) {
+		if (!this->enabled()) return false;
+
+		if (sojourn < this->target) {
+			this->firstAbove = clock::time_point();
+			this->overloaded = false;
+			return false;
+		}
+
+		if (this->firstAbove == clock::time_point())
+			this->firstAbove = now + this->interval;
+		else if (now >= this->firstAbove)
+			this->overloaded = true;
+
+		return this->overloaded || sojourn > this->interval;
+	}
+
+private:
+	clock::duration target = clock::duration::zero();
+	clock::duration interval = std::chrono::milliseconds(100);
+	clock::time_point firstAbove;				// When the wait will have been above target for an interval, zero while below
+	bool overloaded = false;
+};
+
+END_NET_NS
+
+#endif
@@ -20,14 +20,105 @@
 
 #include "net_common.h"
 #include "tsqueue.h"
+#include "mpsc_queue.h"
 #include "message.h"
+#include "token_bucket.h"
+#include "slot_map.h"
 
 BEGIN_NET_NS
 
+/// <summary>
+/// Queue that connections push received messages into. The connections of a server shard
+/// share a queue, define NET_LOCKFREE_INBOUND to replace tsqueue, which
+/// locks on every push and pop, with mpsc_queue, whose pushes do not lock.
+/// </summary>
+#ifdef NET_LOCKFREE_INBOUND
+template <typename T>
+using inbound_queue = mpsc_queue<T>;
+#else
+template <typename T>
+using inbound_queue = tsqueue<T>;
+#endif
+
 //forward declare server interface
 template <typename T>
 class server_interface;
 
+/// <summary>
+/// How a connection pulls messages from its socket.
+/// exact    - Reads the header and then the body with exact size reads, two reads per message.
+/// buffered - Reads as much as the socket has into a per connection buffer and splits every
+///            complete message out of it, many messages per read at the cost of the buffer.
+/// </summary>
+enum class read_mode {
+	exact,
+	buffered
+};
+
+/// <summary>
+/// What a connection does with a message that would push its outgoing queue past
+/// maxOutboundMessages or maxOutboundBytes.
+/// dropOldest - Queue it and drop the oldest queued messages that are not being written yet.
+/// dropNewest - Drop it.
+/// reject     - Do not queue it, send() reports send_status::rejected so the caller can react.
+/// disconnect - Disconnect the connection, it is not keeping up.
+/// </summary>
+enum class overflow_policy {
+	dropOldest,
+	dropNewest,
+	reject,
+	disconnect
+};
+
+/// <summary>
+/// Outcome of a send.
+/// </summary>
+enum class send_status {
+	queued,
+	dropped,
+	rejected,
+	disconnected
+};
+
+/// <summary>
+/// How received messages are handed to onMessage.
+/// serial   - update() calls onMessage for every message on the thread calling update().
+/// parallel - update() hands the messages to a pool of dispatch threads. Messages of one
+///            connection are handled one at a time in the order they arrived, messages of
+///            different connections are handled in parallel, so onMessage must be thread safe.
+///            update() stops taking messages while server_options::maxDispatchInFlight are
+///            waiting for the dispatch threads, the rest stays in the inbound queue.
+/// inline_io - the connection calls onMessage itself on the asio thread as soon as a message
+///            is read, qMessagesIn and update() are bypassed. onMessage must be thread safe when
+///            the asio context runs on more than one thread, and should not block.
+/// </summary>
+enum class dispatch_mode {
+	serial,
+	parallel,
+	inline_io
+};
+
+/// <summary>
+/// Tunables that are handed to every connection by the client or server owning it.
+/// </summary>
+struct connection_options {
+	bool batchWrites = true;					// Gather all queued messages into one write instead of writing them one by one
+	size_t maxBatchBytes = 256 * 1024;			// Upper bound on the bytes of a single batched write
+	size_t maxBatchBuffers = 64;				// Upper bound on the buffers of a single batched write, asio hands at most 64 to writev
+
+	read_mode readMode = read_mode::exact;		// See read_mode
+	size_t readBufferSize = 64 * 1024;			// Initial read buffer size in buffered mode, grows to fit larger messages, at least a header
+
+	size_t maxOutboundMessages = 0;				// Limit on queued and in flight outgoing messages, 0 is unbounded
+	size_t maxOutboundBytes = 0;				// Limit on queued and in flight outgoing bytes, 0 is unbounded
+	overflow_policy overflowPolicy = overflow_policy::reject;
+	size_t highWatermarkBytes = 0;				// Server is told when the outgoing bytes reach this, 0 disables watermarks ...
+	size_t lowWatermarkBytes = 0;				// ... and again when they have drained down to this
+
+	rate_limit inboundLimit;					// Reading pauses while the received messages exceed it, so TCP pushes back on the sender
+	rate_limit outboundLimit;					// Writing waits while the sent messages exceed it
+};
+
 template <typename T>
 class connection : public std::enable_shared_from_this<connection<T>> {
 public:
@@ -35,14 +126,22 @@ public:
 		server,
 		client
 	};
+
+	enum class timer {				// Timers the server runs for a connection, see getTimer
+		handshake,
+		readIdle,
+		heartbeat,
+		count
+	};
 public:
 	connection(
 		owner parent,
 		asio::io_context& asioContext,
 		asio::ip::tcp::socket socket,
-		tsqueue<owned_message<T>>& qIn
+		inbound_queue<owned_message<T>>& qIn,
+		const connection_options& options = {}
 	) 
-		: asioContext(asioContext), socket(std::move(socket)), qMessagesIn(qIn)
+		: socket(std::move(socket)), asioContext(asioContext), strand(asio::make_strand(asioContext)), qMessagesIn(qIn), options(options)
 	{
 		this->ownerType = parent;
 
@@ -57,18 +156,29 @@ public:
 
 	}
 
-	virtual ~connection() { this->disconnect(); }
+	virtual ~connection() {
+		// No handler can be pending anymore, so close right here instead of on the strand
+		std::error_code ec;
+		this->socket.close(ec);
+
+		if (this->destroyHandler)
+			this->destroyHandler();
+	}
 public:
 	/// <summary>
-	/// Connects to client if owner is of server type.
+	/// Connects to client if owner is of server type. The handshake starts on the strand, the
+	/// messages sent before it are written after it.
 	/// </summary>
 	/// <param name="id"></param>
 	void connectToClient(net::server_interface<T>* server, uint32_t id = 0) {
 		if (this->ownerType == owner::server)
 			if (this->socket.is_open()) {
 				this->id = id;
-				writeValidation();
-				readValidation(server);
+				this->server = server;
+				asio::dispatch(this->strand, [this, self = keepAlive(), server]() {
+					writeValidation();
+					readValidation(server);
+				});
 			}
 	}
 
@@ -81,11 +191,11 @@ public:
 			asio::async_connect(
 				this->socket,
 				endpoints,
-				[this](std::error_code ec, asio::ip::tcp::endpoint endpoint) {
+				asio::bind_executor(this->strand, [this, self = keepAlive()](std::error_code ec, asio::ip::tcp::endpoint endpoint) {
 					if (!ec) {
 						readValidation();
 					}
-				});
+				}));
 			return true;
 		}
 		return false;
@@ -96,7 +206,7 @@ public:
 	/// </summary>
 	/// <param name="id"></param>
 	bool disconnect() {
-		if (this->isConnected()) { asio::post(this->asioContext, [this]() { socket.close(); }); return false; }
+		if (this->isConnected()) { asio::post(this->strand, [this, self = keepAlive()]() { close(); }); return false; }
 		return true;
 	}
 
@@ -114,15 +224,62 @@ public:
 	/// </summary>
 	/// <param name="msg"></param>
 	/// <returns></returns>
-	void send(const message<T>& msg) {
+	send_status send(const message<T>& msg) {
+		return this->send(shared_message<T>(msg));
+	}
+
+	/// <summary>
+	/// ASYNC - Send a message, the body is moved into the outgoing queue without a copy.
+	/// </summary>
+	/// <param name="msg"></param>
+	/// <returns></returns>
+	send_status send(message<T>&& msg) {
+		return this->send(shared_message<T>(std::move(msg)));
+	}
+
+	/// <summary>
+	/// ASYNC - Send an already encoded message. The body is not copied, the outgoing
+	/// queue only holds a reference to it, so the same instance can be sent to many
+	/// connections. When the outgoing queue is bounded, the overflow policy decides
+	/// what happens to a message that does not fit. The limits are checked without a
+	/// lock, concurrent senders can overshoot them by a message each.
+	/// </summary>
+	/// <param name="msg"></param>
+	/// <returns>What happened to the message</returns>
+	send_status send(shared_message<T> msg) {
+		size_t bytes = msg.size();
+		if (!this->fitsOutbound(bytes)) {
+			switch (this->options.overflowPolicy) {
+			case overflow_policy::dropNewest:
+				this->nDroppedOutbound++;
+				return send_status::dropped;
+			case overflow_policy::reject:
+				return send_status::rejected;
+			case overflow_policy::disconnect:
+				this->disconnect();
+				return send_status::disconnected;
+			case overflow_policy::dropOldest:
+				break;
+			}
+		}
+
+		this->nOutboundMessages++;
+		this->nLastSend.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+		size_t queuedBytes = this->nOutboundBytes.fetch_add(bytes) + bytes;
+		if (this->options.highWatermarkBytes > 0 && queuedBytes >= this->options.highWatermarkBytes)
+			if (!this->aboveHighWatermark.exchange(true) && this->server)
+				this->server->onClientHighWatermark(this->shared_from_this());
+
 		asio::post(
-			this->asioContext, 
-			[this, msg]() {
-				bool isWritingMsg = !qMessagesOut.empty();
-				qMessagesOut.push_back(msg);
+			this->strand, 
+			[this, self = keepAlive(), msg = std::move(msg)]() mutable {
+				qMessagesOut.push_back(std::move(msg));
+				if (options.overflowPolicy == overflow_policy::dropOldest)
+					dropOldestOutbound();
 				if (!isWritingMsg)
-					writeHeader();
+					writeMessage();
 			});
+		return send_status::queued;
 	}
 public:
 	/// <summary>
@@ -137,12 +294,94 @@ public:
 	/// <returns></returns>
 	inline uint32_t getID() const { return this->id; }
 
+	/// <summary>
+	/// Handler that receives every message on the asio thread instead of the incoming queue,
+	/// used by inline dispatch mode. Set it before the connection starts reading. The message
+	/// may be moved from, its storage is reused for the next read.
+	/// </summary>
+	/// <param name="handler"></param>
+	void setMessageHandler(std::function<void(message<T>&)> handler) {
+		this->messageHandler = std::move(handler);
+	}
+
+	/// <summary>
+	/// Marks a client connection as running on an asio context that keeps running after the
+	/// client let go of it, see client_group. Set it before connecting.
+	/// </summary>
+	/// <param name="shared"></param>
+	inline void setSharedContext(bool shared) { this->sharedContext = shared; }
+
+	/// <summary>
+	/// Handler called from the destructor, on whichever thread let go of the connection last.
+	/// Lets a client on a shared context wait until the handlers are done with the connection.
+	/// </summary>
+	/// <param name="handler"></param>
+	void setDestroyHandler(std::function<void()> handler) {
+		this->destroyHandler = std::move(handler);
+	}
+
+	/// <summary>
+	/// Executor that runs the handlers for this connection's messages in parallel dispatch mode.
+	/// It is a strand, so the handlers of one connection never overlap.
+	/// </summary>
+	/// <returns></returns>
+	inline const asio::any_io_executor& getDispatchExecutor() const { return this->dispatchExecutor; }
+	inline void setDispatchExecutor(asio::any_io_executor executor) { this->dispatchExecutor = std::move(executor); }
+
+	/// <summary>
+	/// Last time something was read from or queued for sending on the connection.
+	/// </summary>
+	/// <returns></returns>
+	inline std::chrono::steady_clock::time_point getLastRead() const {
+		return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(this->nLastRead.load(std::memory_order_relaxed)));
+	}
+	inline std::chrono::steady_clock::time_point getLastSend() const {
+		return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(this->nLastSend.load(std::memory_order_relaxed)));
+	}
+
+	/// <summary>
+	/// Handle of a timer the server runs for this connection, so the server can cancel it when
+	/// the connection closes. The timers store the handle of their next run as they re-arm.
+	/// </summary>
+	/// <param name="which"></param>
+	/// <returns></returns>
+	inline std::atomic<slot_key>& getTimer(timer which) { return this->timerKeys[size_t(which)]; }
+
+	/// <summary>
+	/// True once the remote passed the handshake.
+	/// </summary>
+	/// <returns></returns>
+	inline bool isValidated() const { return this->validated; }
+
+	/// <summary>
+	/// Share of the server's update() budget the connection gets in fair inbound scheduling,
+	/// relative to the other connections. Never below 1.
+	/// </summary>
+	/// <returns></returns>
+	inline uint32_t getInboundWeight() const { return this->nInboundWeight; }
+	inline void setInboundWeight(uint32_t weight) { this->nInboundWeight = std::max<uint32_t>(1, weight); }
+
+	/// <summary>
+	/// Outgoing messages and bytes that are queued or being written.
+	/// </summary>
+	/// <returns></returns>
+	inline size_t getOutboundMessages() const { return this->nOutboundMessages; }
+	inline size_t getOutboundBytes() const { return this->nOutboundBytes; }
+
+	/// <summary>
+	/// Outgoing messages dropped by the overflow policy.
+	/// </summary>
+	/// <returns></returns>
+	inline uint64_t getDroppedOutbound() const { return this->nDroppedOutbound; }
+
 protected:
 	asio::ip::tcp::socket socket;				// Each connection has a unique socket to a remote
 	asio::io_context& asioContext;				// This context is shared with the entire asio instance - PROVIDED BY SERVER
-	tsqueue<message<T>> qMessagesOut;			// This queue holds all messages to be sent to the remote side of this connection
-	tsqueue<owned_message<T>>& qMessagesIn;		// This queue holds all messages that have been received from the remote side of this connection - PROVIDED BY CLIENT/SERVER
+	asio::strand<asio::io_context::executor_type> strand;	// Serializes the handlers of this connection when the context runs on several threads
+	tsqueue<shared_message<T>> qMessagesOut;	// This queue holds all messages to be sent to the remote side of this connection
+	inbound_queue<owned_message<T>>& qMessagesIn;	// This queue holds all messages that have been received from the remote side of this connection - PROVIDED BY CLIENT/SERVER
 	message<T> msgTemporaryIn;
+	connection_options options;
 protected: // 3-Way Handshake Validation
 	uint64_t handShakeOut = 0;
 	uint64_t handShakeIn = 0;
@@ -159,22 +398,24 @@ private:
 				&this->msgTemporaryIn.getHeader(),
 				sizeof(message_header<T>)
 			), 
-			[this](std::error_code ec, std::size_t length) {
+			asio::bind_executor(this->strand, [this, self = keepAlive()](std::error_code ec, std::size_t length) {
 				if (!ec) {
+					markRead();
 					if (msgTemporaryIn.getHeader().size > 0) {
-						msgTemporaryIn.getBody().resize(msgTemporaryIn.getHeader().size);
+						msgTemporaryIn.getBody().resize_uninitialized(msgTemporaryIn.getHeader().size);
 						readBody();
 					}
 					else {
 						addToIncomingMessageQueue();
+						readNext();
 					}
 				}
 				else {
 					std::cout << "[" << id << "] Read Header Fail.\n";
-					socket.close();
+					close();
 				}
 
-			});
+			}));
 	}
 
 	/// <summary>
@@ -187,71 +428,239 @@ private:
 				this->msgTemporaryIn.getBody().data(),
 				this->msgTemporaryIn.getBody().size()
 			),
-			[this](std::error_code ec, std::size_t length) {
+			asio::bind_executor(this->strand, [this, self = keepAlive()](std::error_code ec, std::size_t length) {
 				if (!ec) {
+					markRead();
 					addToIncomingMessageQueue();
+					readNext();
 				}
 				else {
 					std::cout << "[" << id << "] Read Body Fail.\n";
-					socket.close();
+					close();
 				}
-			});
+			}));
 	}
 
 	/// <summary>
-	/// ASYNC - Prime context ready to write a message header
+	/// ASYNC - Prime context ready to read whatever the socket has into the read buffer.
 	/// </summary>
-	void writeHeader() {
-		asio::async_write(
-			this->socket,
+	void readBuffered() {
+		// Too small for a header the buffer would fill up without a message ever being complete
+		if (this->vecReadBuffer.empty())
+			this->vecReadBuffer.resize(std::max(this->options.readBufferSize, sizeof(message_header<T>)));
+
+		this->socket.async_read_some(
 			asio::buffer(
-				&this->qMessagesOut.front().getHeader(),
-				sizeof(message_header<T>)
+				this->vecReadBuffer.data() + this->nReadEnd,
+				this->vecReadBuffer.size() - this->nReadEnd
 			),
-			[this](std::error_code ec, std::size_t length) {
+			asio::bind_executor(this->strand, [this, self = keepAlive()](std::error_code ec, std::size_t length) {
 				if (!ec) {
-					if (qMessagesOut.front().getBody().size() > 0) {
-						writeBody();
-					}
-					else {
-						qMessagesOut.pop_front();
-						if (!qMessagesOut.empty())
-							writeHeader();
-					}
-
+					markRead();
+					nReadEnd += length;
+					readNext();
 				}
 				else {
-					std::cout << "[" << id << "] Write Header Fail.\n";
-					socket.close();
+					std::cout << "[" << id << "] Read Fail.\n";
+					close();
 				}
-			});
+			}));
+	}
+
+	/// <summary>
+	/// ASYNC - Continues reading after a message, or first waits until the inbound limits of the
+	/// connection and server are out of debt. No read is pending while waiting, so the socket's
+	/// receive buffer fills up and TCP flow control slows the sender down.
+	/// </summary>
+	void readNext() {
+		auto wait = this->inboundDelay();
+		if (wait > std::chrono::steady_clock::duration::zero()) {
+			this->readPauseTimer.expires_after(wait);
+			this->readPauseTimer.async_wait(
+				asio::bind_executor(this->strand, [this, self = keepAlive()](std::error_code ec) {
+					if (!ec && socket.is_open())
+						readNext();
+				}));
+			return;
+		}
+
+		if (this->options.readMode == read_mode::buffered) {
+			if (splitBufferedMessages())
+				readNext();
+			else
+				readBuffered();
+		}
+		else
+			readHeader();
+	}
+
+	/// <summary>
+	/// Time until the inbound limits of the connection and its server are out of debt.
+	/// </summary>
+	/// <returns></returns>
+	std::chrono::steady_clock::duration inboundDelay() {
+		auto wait = this->inboundLimiter.delay();
+		if (this->server)
+			wait = std::max(wait, this->server->inboundDelay());
+		return wait;
+	}
+
+	/// <summary>
+	/// Moves every complete message in the read buffer to the incoming message queue.
+	/// A trailing partial message is moved to the front of the buffer, which grows when
+	/// the message, or a header that is not complete yet, would not fit.
+	/// </summary>
+	/// <returns>True if it stopped early because an inbound limit ran out</returns>
+	bool splitBufferedMessages() {
+		bool limited = this->inboundLimiter.limited() || (this->server && this->server->inboundLimited());
+		bool paused = false;
+		size_t frameSize = 0;
+		while (this->nReadEnd - this->nReadStart >= sizeof(message_header<T>)) {
+			const uint8_t* frame = this->vecReadBuffer.data() + this->nReadStart;
+			std::memcpy(&this->msgTemporaryIn.getHeader(), frame, sizeof(message_header<T>));
+
+			frameSize = sizeof(message_header<T>) + this->msgTemporaryIn.getHeader().size;
+			if (this->nReadEnd - this->nReadStart < frameSize)
+				break;
+
+			this->msgTemporaryIn.getBody().assign(frame + sizeof(message_header<T>), frame + frameSize);
+			this->addToIncomingMessageQueue();
+
+			this->nReadStart += frameSize;
+			frameSize = 0;
+
+			if (limited && this->inboundDelay() > std::chrono::steady_clock::duration::zero()) {
+				paused = true;
+				break;
+			}
+		}
+
+		if (this->nReadStart > 0) {
+			std::memmove(
+				this->vecReadBuffer.data(),
+				this->vecReadBuffer.data() + this->nReadStart,
+				this->nReadEnd - this->nReadStart);
+			this->nReadEnd -= this->nReadStart;
+			this->nReadStart = 0;
+		}
+
+		size_t needed = std::max(frameSize, sizeof(message_header<T>));
+		if (needed > this->vecReadBuffer.size())
+			this->vecReadBuffer.resize(needed);
+		return paused;
+	}
+
+	/// <summary>
+	/// ASYNC - Starts reading messages in the configured read mode.
+	/// </summary>
+	void startReading() {
+		if (this->options.readMode == read_mode::buffered)
+			readBuffered();
+		else
+			readHeader();
 	}
 
 	/// <summary>
-	/// ASYNC - Prime context ready to write a message body
+	/// ASYNC - Prime context ready to write the queued messages. Each message is handed
+	/// to asio as a header and body buffer, and when batching is enabled every queued
+	/// message that fits within the batch limits is gathered into the same write.
 	/// </summary>
-	void writeBody() {
+	void writeMessage() {
+		this->isWritingMsg = true;
+
+		auto wait = this->outboundLimiter.delay();
+		if (wait > std::chrono::steady_clock::duration::zero()) {
+			this->writePauseTimer.expires_after(wait);
+			this->writePauseTimer.async_wait(
+				asio::bind_executor(this->strand, [this, self = keepAlive()](std::error_code ec) {
+					if (!ec && socket.is_open() && !qMessagesOut.empty())
+						writeMessage();
+					else
+						isWritingMsg = false;
+				}));
+			return;
+		}
+
+		this->vecWriteBuffers.clear();
+
+		size_t batchBytes = 0;
+		do {
+			const shared_message<T>& msg = this->qMessagesOut.front();
+			if (!this->vecWriteBatch.empty() &&
+				(batchBytes + msg.size() > this->options.maxBatchBytes ||
+				 this->vecWriteBuffers.size() + 2 > this->options.maxBatchBuffers ||
+				 (this->outboundLimiter.limited() && !this->outboundLimiter.fits(this->vecWriteBatch.size(), batchBytes, msg.size()))))
+				break;
+
+			this->vecWriteBuffers.push_back(asio::buffer(&msg.getHeader(), sizeof(message_header<T>)));
+			if (!msg.getBody().empty())
+				this->vecWriteBuffers.push_back(asio::buffer(msg.getBody().data(), msg.getBody().size()));
+
+			batchBytes += msg.size();
+			this->vecWriteBatch.push_back(this->qMessagesOut.pop_front());
+		} while (this->options.batchWrites && !this->qMessagesOut.empty());
+		this->outboundLimiter.consume(this->vecWriteBatch.size(), batchBytes);
+
 		asio::async_write(
 			this->socket,
-			asio::buffer(
-				this->qMessagesOut.front().getBody().data(),
-				this->qMessagesOut.front().getBody().size()
-			),
-			[this](std::error_code ec, std::size_t length) {
+			this->vecWriteBuffers,
+			asio::bind_executor(this->strand, [this, self = keepAlive()](std::error_code ec, std::size_t length) {
+				for (const shared_message<T>& msg : vecWriteBatch)
+					releaseOutbound(msg.size());
+				vecWriteBatch.clear();
+				isWritingMsg = false;
+
 				if (!ec) {
-					qMessagesOut.pop_front();
 					if (!qMessagesOut.empty())
-						writeHeader();
+						writeMessage();
 				}
 				else {
-					std::cout << "[" << id << "] Write Body Fail.\n";
-					socket.close();
+					std::cout << "[" << id << "] Write Message Fail.\n";
+					close();
 				}
-			});
+			}));
 	}
 
 	/// <summary>
-	/// ASYNC - Used by both client and server to write validation packet
+	/// Checks if a message of the given size stays within the outgoing limits.
+	/// </summary>
+	/// <param name="bytes"></param>
+	/// <returns></returns>
+	bool fitsOutbound(size_t bytes) const {
+		if (this->options.maxOutboundMessages > 0 && this->nOutboundMessages + 1 > this->options.maxOutboundMessages)
+			return false;
+		if (this->options.maxOutboundBytes > 0 && this->nOutboundBytes + bytes > this->options.maxOutboundBytes)
+			return false;
+		return true;
+	}
+
+	/// <summary>
+	/// Takes a written or dropped message off the outgoing accounting.
+	/// </summary>
+	/// <param name="bytes"></param>
+	void releaseOutbound(size_t bytes) {
+		this->nOutboundMessages--;
+		size_t queuedBytes = this->nOutboundBytes.fetch_sub(bytes) - bytes;
+		if (queuedBytes <= this->options.lowWatermarkBytes && this->aboveHighWatermark.exchange(false) && this->server)
+			this->server->onClientLowWatermark(this->shared_from_this());
+	}
+
+	/// <summary>
+	/// Drops the oldest queued messages until the outgoing limits are met again. The newest
+	/// message and the messages being written are never dropped.
+	/// </summary>
+	void dropOldestOutbound() {
+		while (this->qMessagesOut.count() > 1 &&
+			((this->options.maxOutboundMessages > 0 && this->nOutboundMessages > this->options.maxOutboundMessages) ||
+			 (this->options.maxOutboundBytes > 0 && this->nOutboundBytes > this->options.maxOutboundBytes))) {
+			this->releaseOutbound(this->qMessagesOut.pop_front().size());
+			this->nDroppedOutbound++;
+		}
+	}
+
+	/// <summary>
+	/// ASYNC - Used by both client and server to write validation packet. No message is
+	/// written before it, isWritingMsg holds them back until it completes.
 	/// </summary>
 	void writeValidation() {
 		asio::async_write(
@@ -260,14 +669,18 @@ private:
 				&this->handShakeOut,
 				sizeof(uint64_t)
 			),
-			[this](std::error_code ec, std::size_t length) {
+			asio::bind_executor(this->strand, [this, self = keepAlive()](std::error_code ec, std::size_t length) {
 				if (!ec) {
-					if (ownerType == owner::client) readHeader();
+					if (ownerType == owner::client) startReading();
+
+					isWritingMsg = false;
+					if (!qMessagesOut.empty())
+						writeMessage();
 				}
 				else {
-					socket.close();
+					close();
 				}
-			});
+			}));
 	} 
 
 	/// <summary>
@@ -280,15 +693,19 @@ private:
 				&this->handShakeIn,
 				sizeof(uint64_t)
 			),
-			[this, server](std::error_code ec, std::size_t length) {
+			asio::bind_executor(this->strand, [this, self = keepAlive(), server](std::error_code ec, std::size_t length) {
 				if (!ec) {
+					markRead();
 					if (ownerType == owner::server) {
 						if (handShakeIn == handShakeCheck) {
+							validated = true;
 							std::cout << "Client Validated\n";
 							server->onClientValidated(this->shared_from_this());
 
-							readHeader();
+							startReading();
 						}
+						else
+							close();
 					}
 					else {
 						handShakeOut = scramble(handShakeIn);
@@ -297,9 +714,45 @@ private:
 				}
 				else {
 					std::cout << "Client Disconnected (ReadValidation)" << std::endl;
-					socket.close();
+					close();
 				}
-			});
+			}));
+	}
+
+	/// <summary>
+	/// Captured by every handler, so a server connection lives until its last handler ran even
+	/// when the server already let go of it, as does a client connection on a shared context.
+	/// Null for the other client connections, the client stops its asio context before
+	/// destroying the connection.
+	/// </summary>
+	/// <returns></returns>
+	inline ref<connection<T>> keepAlive() {
+		return this->ownerType == owner::server || this->sharedContext ? this->shared_from_this() : nullptr;
+	}
+
+	/// <summary>
+	/// Stamps the time of the last read, which the server's timeouts compare against.
+	/// </summary>
+	inline void markRead() {
+		this->nLastRead.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+	}
+
+	/// <summary>
+	/// Closes the socket, on the strand. The first close is reported to the owning server, so
+	/// it can drop the connection without waiting for a send to run into it.
+	/// </summary>
+	void close() {
+		if (this->socket.is_open()) {
+			std::error_code ec;
+			this->socket.close(ec);
+		}
+		this->readPauseTimer.cancel();
+		this->writePauseTimer.cancel();
+
+		if (this->server && !this->closeReported) {
+			this->closeReported = true;
+			this->server->onConnectionClosed(this->shared_from_this());
+		}
 	}
 
 	/// <summary>
@@ -314,20 +767,59 @@ private:
 	}
 
 	/// <summary>
-	/// Adds messages to the incoming message queue.
+	/// Adds messages to the incoming message queue. The temporary message is moved
+	/// into the queue, leaving it empty for the next read.
 	/// </summary>
 	void addToIncomingMessageQueue() {
-		if (this->ownerType == owner::server)
-			this->qMessagesIn.push_back(owned_message<T>(this->msgTemporaryIn, this->shared_from_this()));
-		else
-			this->qMessagesIn.push_back(owned_message<T>(this->msgTemporaryIn));
+		size_t bytes = sizeof(message_header<T>) + this->msgTemporaryIn.getBody().size();
+		this->inboundLimiter.consume(1, bytes);
+		if (this->server)
+			this->server->chargeInbound(bytes);
+
+		if (this->messageHandler) {
+			this->messageHandler(this->msgTemporaryIn);
+			this->msgTemporaryIn.getBody().clear();
+			return;
+		}
 
-		this->readHeader();
+		if (this->ownerType == owner::server) {
+			this->qMessagesIn.emplace_back(std::move(this->msgTemporaryIn), this->shared_from_this());
+			if (this->server)
+				this->server->notifyIncoming();
+		}
+		else
+			this->qMessagesIn.emplace_back(std::move(this->msgTemporaryIn));
 	}
 
+private:
+	std::vector<shared_message<T>> vecWriteBatch;				// Messages that are part of the write in flight
+	std::vector<asio::const_buffer> vecWriteBuffers;			// Header and body buffers of the write in flight
+	bool isWritingMsg = true;									// Only touched from the asio context, set until the handshake is written
+	std::vector<uint8_t> vecReadBuffer;							// Read buffer in buffered read mode ...
+	size_t nReadStart = 0;										// ... offset of the first unparsed byte ...
+	size_t nReadEnd = 0;										// ... and the end of the received bytes
+	std::atomic<size_t> nOutboundMessages{ 0 };					// Queued and in flight outgoing messages ...
+	std::atomic<size_t> nOutboundBytes{ 0 };					// ... and their size, updated by send() and the asio context
+	std::atomic<uint64_t> nDroppedOutbound{ 0 };
+	std::atomic<bool> aboveHighWatermark{ false };
+	rate_limiter inboundLimiter{ options.inboundLimit };		// Only touched from the asio context ...
+	rate_limiter outboundLimiter{ options.outboundLimit };
+	asio::steady_timer readPauseTimer{ asioContext };			// ... as are the timers that wait out the limits
+	asio::steady_timer writePauseTimer{ asioContext };
 private:
 	owner ownerType = owner::server;							// The "owner" decides how some of the connections behave.
 	uint32_t id = 0;											// The client ID
+	net::server_interface<T>* server = nullptr;					// Owning server, null for client connections
+	asio::any_io_executor dispatchExecutor;						// Set by the server in parallel dispatch mode
+	std::function<void(message<T>&)> messageHandler;			// Bypasses qMessagesIn in inline dispatch mode
+	std::function<void()> destroyHandler;						// See setDestroyHandler
+	bool closeReported = false;									// Only touched from the asio context
+	bool sharedContext = false;									// See setSharedContext
+	std::atomic<bool> validated{ false };
+	std::atomic<uint32_t> nInboundWeight{ 1 };
+	std::array<std::atomic<slot_key>, size_t(timer::count)> timerKeys{};	// See getTimer
+	std::atomic<int64_t> nLastRead{ std::chrono::steady_clock::now().time_since_epoch().count() };	// steady_clock ticks, read by the server's timers
+	std::atomic<int64_t> nLastSend{ std::chrono::steady_clock::now().time_since_epoch().count() };
 };
 
 END_NET_NS
@@ -19,12 +19,15 @@
 #define _NETWORK_MESSAGE_
 
 #include "net_common.h"
+#include "buffer_pool.h"
+#include "message_body.h"
 
 BEGIN_NET_NS
 
 /// <summary>
 /// Message Header s sent at the start of all messages.
 /// The template allows us to use a user defined enum class.
+/// The size field holds the number of body bytes that follow the header.
 /// </summary>
 /// <typeparam name="T"> = User defined enum-class </typeparam>
 template <typename T>
@@ -34,13 +37,17 @@ struct message_header {
 };
 
 /// <summary>
-/// Message Body contains a header and a std::vector, containing raw bytes
+/// Message Body contains a header and a message_body, containing raw bytes
 /// of infomation. This way the message can be variable length, but the size
-/// in the header must be updated.
+/// in the header must be updated. Small bodies are stored inline, larger ones
+/// take their memory from the buffer_pool.
 /// </summary>
 /// <typeparam name="T"> = User defined enum-class </typeparam>
 template <typename T>
 class message {
+public:
+	using body_type = message_body;
+
 public:
 
 	/// <summary>
@@ -52,13 +59,13 @@ public:
 	}
 
 	inline message_header<T>& getHeader() { return this->header; }
-	inline std::vector<uint8_t>& getBody() { return this->body; }
-	inline message_header<T> getHeader() const { return this->header; }
-	inline std::vector<uint8_t> getBody() const { return this->body; }
+	inline body_type& getBody() { return this->body; }
+	inline const message_header<T>& getHeader() const { return this->header; }
+	inline const body_type& getBody() const { return this->body; }
 
 private:
 	message_header<T> header{};
-	std::vector<uint8_t> body;
+	body_type body;
 public:
 	/// <summary>
 	/// Override for std::cout compatibility.
@@ -84,9 +91,9 @@ public:
 		static_assert(std::is_standard_layout<DT>::value, "Type is too complex to use!");
 
 		size_t i = msg.getBody().size();
-		msg.body.resize(msg.getBody().size() + sizeof(DT));
+		msg.body.resize_uninitialized(msg.getBody().size() + sizeof(DT));
 		std::memcpy(msg.getBody().data() + i, &data, sizeof(DT));
-		msg.header.size = msg.size();
+		msg.header.size = uint32_t(msg.body.size());
 
 		return msg;
 	}
@@ -104,13 +111,63 @@ public:
 
 		size_t i = msg.getBody().size() - sizeof(DT);
 		std::memcpy(&data, msg.getBody().data() + i, sizeof(DT));
-		msg.body.resize(i);
-		msg.getHeader().size = msg.size();
+		msg.body.resize_uninitialized(i);
+		msg.getHeader().size = uint32_t(msg.body.size());
 
 		return msg;
 	}
 };
 
+/// <summary>
+/// A shared message is an immutable, reference counted copy of a message.
+/// The header and body are copied once on construction, after which any number
+/// of connections can queue the same instance and write straight from its bytes.
+/// This makes a broadcast cost a single body copy instead of one per client.
+/// </summary>
+/// <typeparam name="T"> = User defined enum-class </typeparam>
+template <typename T>
+class shared_message {
+public:
+	shared_message() = default;
+	explicit shared_message(const message<T>& msg) {
+		payload encoded{ msg.getHeader(), msg.getBody() };
+		encoded.header.size = uint32_t(encoded.body.size());
+		this->frame = std::allocate_shared<const payload>(pool_allocator<payload>(), std::move(encoded));
+	}
+
+	explicit shared_message(message<T>&& msg) {
+		payload encoded{ msg.getHeader(), std::move(msg.getBody()) };
+		encoded.header.size = uint32_t(encoded.body.size());
+		this->frame = std::allocate_shared<const payload>(pool_allocator<payload>(), std::move(encoded));
+	}
+
+public:
+	/// <summary>
+	/// Returns size of entire message packet
+	/// </summary>
+	/// <returns>Size in bytes</returns>
+	size_t size() const {
+		return this->frame->body.size() + sizeof(message_header<T>);
+	}
+
+	inline const message_header<T>& getHeader() const { return this->frame->header; }
+	inline const typename message<T>::body_type& getBody() const { return this->frame->body; }
+
+	/// <summary>
+	/// Checks if this instance references a message.
+	/// </summary>
+	/// <returns></returns>
+	explicit operator bool() const { return this->frame != nullptr; }
+
+private:
+	struct payload {
+		message_header<T> header;
+		typename message<T>::body_type body;
+	};
+
+	std::shared_ptr<const payload> frame = nullptr;
+};
+
 // Forward declare the conenction because we use it in this file.
 template <typename T>
 class connection;
@@ -125,15 +182,21 @@ template <typename T>
 class owned_message {
 public:
 	inline message<T>& getMsg() { return this->msg; }
+	inline const message<T>& getMsg() const { return this->msg; }
 	inline ref<connection<T>> getRemote() const { return this->remote; }
+	inline std::chrono::steady_clock::time_point getReceived() const { return this->received; }
 public:
 	owned_message() = default;
 	owned_message(const message<T>& msg, ref<connection<T>> remote = nullptr) 
-		: msg(msg), remote(remote)
+		: msg(msg), remote(std::move(remote))
+	{}
+	owned_message(message<T>&& msg, ref<connection<T>> remote = nullptr) 
+		: msg(std::move(msg)), remote(std::move(remote))
 	{}
 private:
 	message<T> msg;
 	ref<connection<T>> remote = nullptr;
+	std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();	// When the message was queued, for the server's queue management
 public:
 	/// <summary>
 	/// Override for std::cout compatibility.
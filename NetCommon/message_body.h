@@ -0,0 +1,178 @@
+/*
+ * NetWeave - C++ Networking Library
+ * Copyright 2024 - Jessy van Polanen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NETWORK_MESSAGE_BODY_
+#define _NETWORK_MESSAGE_BODY_
+
+#include "net_common.h"
+#include "buffer_pool.h"
+
+BEGIN_NET_NS
+
+/// <summary>
+/// Byte container used as message body. Payloads up to inlineCapacity bytes live inside
+/// the object itself, larger payloads are stored in a block from the buffer_pool.
+/// The interface follows std::vector, with resize_uninitialized() added for callers
+/// that overwrite the new bytes anyway, such as socket reads.
+/// </summary>
+class message_body {
+public:
+	static constexpr size_t inlineCapacity = 64;
+
+public:
+	message_body() = default;
+
+	message_body(const message_body& other) {
+		this->resize_uninitialized(other.nSize);
+		std::memcpy(this->data(), other.data(), other.nSize);
+	}
+
+	message_body(message_body&& other) noexcept {
+		this->take(other);
+	}
+
+	~message_body() {
+		this->releaseHeap();
+	}
+
+	message_body& operator = (const message_body& other) {
+		if (this != &other) {
+			this->resize_uninitialized(other.nSize);
+			std::memcpy(this->data(), other.data(), other.nSize);
+		}
+		return *this;
+	}
+
+	message_body& operator = (message_body&& other) noexcept {
+		if (this != &other) {
+			this->releaseHeap();
+			this->take(other);
+		}
+		return *this;
+	}
+
+public:
+	inline uint8_t* data() { return this->heap ? this->heap : this->inlineData; }
+	inline const uint8_t* data() const { return this->heap ? this->heap : this->inlineData; }
+	inline size_t size() const { return this->nSize; }
+	inline size_t capacity() const { return this->heap ? this->nCapacity : inlineCapacity; }
+	inline bool empty() const { return this->nSize == 0; }
+	inline bool isInline() const { return this->heap == nullptr; }
+
+	inline uint8_t* begin() { return this->data(); }
+	inline uint8_t* end() { return this->data() + this->nSize; }
+	inline const uint8_t* begin() const { return this->data(); }
+	inline const uint8_t* end() const { return this->data() + this->nSize; }
+
+	inline uint8_t& operator [] (size_t i) { return this->data()[i]; }
+	inline const uint8_t& operator [] (size_t i) const { return this->data()[i]; }
+
+	/// <summary>
+	/// Makes room for at least size bytes, keeping the current contents.
+	/// </summary>
+	/// <param name="size"></param>
+	void reserve(size_t size) {
+		if (size <= this->capacity()) return;
+
+		size_t capacity = buffer_pool::blockSize(size);
+		uint8_t* block = buffer_pool::acquireLocal(capacity);
+		std::memcpy(block, this->data(), this->nSize);
+
+		this->releaseHeap();
+		this->heap = block;
+		this->nCapacity = capacity;
+	}
+
+	/// <summary>
+	/// Resizes the body, new bytes are left uninitialized.
+	/// </summary>
+	/// <param name="size"></param>
+	void resize_uninitialized(size_t size) {
+		if (size > this->capacity())
+			this->reserve(std::max(size, this->capacity() * 2));
+		this->nSize = size;
+	}
+
+	/// <summary>
+	/// Resizes the body, new bytes are set to zero.
+	/// </summary>
+	/// <param name="size"></param>
+	void resize(size_t size) {
+		size_t old = this->nSize;
+		this->resize_uninitialized(size);
+		if (size > old)
+			std::memset(this->data() + old, 0, size - old);
+	}
+
+	/// <summary>
+	/// Replaces the contents with the bytes in [first, last).
+	/// </summary>
+	/// <param name="first"></param>
+	/// <param name="last"></param>
+	void assign(const uint8_t* first, const uint8_t* last) {
+		this->resize_uninitialized(size_t(last - first));
+		std::memcpy(this->data(), first, this->nSize);
+	}
+
+	/// <summary>
+	/// Empties the body, heap storage is kept for reuse.
+	/// </summary>
+	void clear() { this->nSize = 0; }
+
+	/// <summary>
+	/// Returns heap storage to the pool if the contents fit inline.
+	/// </summary>
+	void shrink_to_fit() {
+		if (this->heap && this->nSize <= inlineCapacity) {
+			uint8_t* block = this->heap;
+			std::memcpy(this->inlineData, block, this->nSize);
+			buffer_pool::releaseLocal(block, this->nCapacity);
+			this->heap = nullptr;
+			this->nCapacity = 0;
+		}
+	}
+
+private:
+	void releaseHeap() {
+		if (this->heap) buffer_pool::releaseLocal(this->heap, this->nCapacity);
+		this->heap = nullptr;
+		this->nCapacity = 0;
+	}
+
+	void take(message_body& other) {
+		this->nSize = other.nSize;
+		if (other.heap) {
+			this->heap = other.heap;
+			this->nCapacity = other.nCapacity;
+			other.heap = nullptr;
+			other.nCapacity = 0;
+		}
+		else
+			std::memcpy(this->inlineData, other.inlineData, other.nSize);
+		other.nSize = 0;
+	}
+
+private:
+	uint8_t* heap = nullptr;			// Pool block when the body does not fit inline
+	size_t nSize = 0;
+	size_t nCapacity = 0;				// Capacity of the heap block
+	alignas(std::max_align_t) uint8_t inlineData[inlineCapacity];
+};
+
+END_NET_NS
+
+#endif
\ No newline at end of file
@@ -0,0 +1,169 @@
+/*
+ * NetWeave - C++ Networking Library
+ * Copyright 2024 - Jessy van Polanen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NETWORK_MESSAGE_VIEW_
+#define _NETWORK_MESSAGE_VIEW_
+
+#include "net_common.h"
+#include "message.h"
+
+BEGIN_NET_NS
+
+/// <summary>
+/// Read only view of a message body with a forward cursor. Fields come out in the order
+/// they were pushed with operator <<, and the body itself is never modified or copied,
+/// so the view stays valid only as long as the message it was created from.
+/// A read that does not fit in the remaining bytes consumes nothing and puts the view
+/// in a failed state, which can be checked once after a series of reads.
+/// </summary>
+/// <typeparam name="T"> = User defined enum-class </typeparam>
+template <typename T>
+class message_view {
+public:
+	explicit message_view(const message<T>& msg)
+		: header(msg.getHeader()), first(msg.getBody().data()), last(msg.getBody().data() + msg.getBody().size()), cursor(first)
+	{}
+
+	message_view(const message_header<T>& header, const uint8_t* data, size_t size)
+		: header(header), first(data), last(data + size), cursor(data)
+	{}
+
+public:
+	inline const message_header<T>& getHeader() const { return this->header; }
+
+	/// <summary>
+	/// Bytes that have not been read yet.
+	/// </summary>
+	/// <returns>Size in bytes</returns>
+	inline size_t remaining() const { return size_t(this->last - this->cursor); }
+
+	/// <summary>
+	/// Offset of the cursor from the start of the body.
+	/// </summary>
+	/// <returns>Offset in bytes</returns>
+	inline size_t position() const { return size_t(this->cursor - this->first); }
+
+	/// <summary>
+	/// False once a read did not fit in the remaining bytes.
+	/// </summary>
+	/// <returns></returns>
+	inline bool good() const { return !this->failed; }
+	explicit operator bool() const { return !this->failed; }
+
+	/// <summary>
+	/// Reads one or more fields in order. The bounds are checked once for all of them,
+	/// nothing is read if they do not fit together.
+	/// </summary>
+	/// <typeparam name="...DT"></typeparam>
+	/// <param name="...data"></param>
+	/// <returns>True if all fields were read</returns>
+	template <typename... DT>
+	bool read(DT&... data) {
+		static_assert((std::is_standard_layout<DT>::value && ...), "Type is too complex to use!");
+
+		if (!this->require((sizeof(DT) + ...)))
+			return false;
+
+		(this->copyOut(data), ...);
+		return true;
+	}
+
+	/// <summary>
+	/// Reads a single field by value.
+	/// </summary>
+	/// <typeparam name="DT"></typeparam>
+	/// <returns>The field, or a value initialized DT if it did not fit</returns>
+	template <typename DT>
+	DT read() {
+		DT data{};
+		this->read(data);
+		return data;
+	}
+
+	/// <summary>
+	/// Returns a pointer to the next size bytes of the body and moves past them.
+	/// </summary>
+	/// <param name="size"></param>
+	/// <returns>Pointer into the body, nullptr if the bytes are not there</returns>
+	const uint8_t* bytes(size_t size) {
+		if (!this->require(size))
+			return nullptr;
+
+		const uint8_t* data = this->cursor;
+		this->cursor += size;
+		return data;
+	}
+
+	/// <summary>
+	/// Returns the next size bytes of the body as text and moves past them.
+	/// </summary>
+	/// <param name="size"></param>
+	/// <returns>View into the body, empty if the bytes are not there</returns>
+	std::string_view string(size_t size) {
+		const uint8_t* data = this->bytes(size);
+		if (data == nullptr) return {};
+		return std::string_view(reinterpret_cast<const char*>(data), size);
+	}
+
+	/// <summary>
+	/// Moves the cursor past size bytes.
+	/// </summary>
+	/// <param name="size"></param>
+	/// <returns>True if the bytes were there</returns>
+	bool skip(size_t size) {
+		return this->bytes(size) != nullptr;
+	}
+
+	/// <summary>
+	/// Reads the next field, check good() once after a chain of reads.
+	/// </summary>
+	/// <typeparam name="DT"></typeparam>
+	/// <param name="view"></param>
+	/// <param name="data"></param>
+	/// <returns>The view</returns>
+	template <typename DT>
+	friend message_view<T>& operator >> (message_view<T>& view, DT& data) {
+		view.read(data);
+		return view;
+	}
+
+private:
+	bool require(size_t size) {
+		if (this->failed || size > this->remaining()) {
+			this->failed = true;
+			return false;
+		}
+		return true;
+	}
+
+	template <typename DT>
+	void copyOut(DT& data) {
+		std::memcpy(&data, this->cursor, sizeof(DT));
+		this->cursor += sizeof(DT);
+	}
+
+private:
+	message_header<T> header;
+	const uint8_t* first = nullptr;
+	const uint8_t* last = nullptr;
+	const uint8_t* cursor = nullptr;
+	bool failed = false;
+};
+
+END_NET_NS
+
+#endif
\ No newline at end of file
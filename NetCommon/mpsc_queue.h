@@ -0,0 +1,282 @@
+/*
+ * NetWeave - C++ Networking Library
+ * Copyright 2024 - Jessy van Polanen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MPSC_QUEUE_
+#define _MPSC_QUEUE_
+
+#include "net_common.h"
+
+BEGIN_NET_NS
+
+/// <summary>
+/// Unbounded multi-producer / single-consumer queue.
+/// Any number of threads may push, but only one thread at a time may use the consumer
+/// side (front, pop_front, wait, clear). A push takes a node from a lock-free free list
+/// and links it with a single atomic exchange. The consumer hands the nodes it is done with
+/// back to that list in batches of freeBatch. The nodes live in chunks that grow in size
+/// and are only freed with the queue, a push allocates a new chunk when the list is empty.
+/// The free list holds node indices tagged with a counter, so a producer that was
+/// overtaken while taking a node fails its compare exchange instead of suffering ABA.
+/// The consumer parks on a condition variable in wait(), and producers only take its
+/// mutex to wake the consumer when it is parked.
+/// Offers the same interface as tsqueue for its producer/consumer operations, so it can
+/// be used as the incoming message queue (see inbound_queue).
+/// </summary>
+/// <typeparam name="T"></typeparam>
+template <typename T>
+class mpsc_queue {
+public:
+	static constexpr size_t firstChunkNodes = 16;
+	static constexpr size_t maxChunks = 28;				// Chunk c holds firstChunkNodes << c nodes, indices stay below 2^32
+	static constexpr size_t freeBatch = 32;				// Consumed nodes handed back to the free list at once
+
+public:
+	mpsc_queue() {
+		this->tail = this->allocateNode();
+		this->head.store(this->tail, std::memory_order_relaxed);
+	}
+
+	mpsc_queue(const mpsc_queue<T>&) = delete;
+
+	virtual ~mpsc_queue() {
+		this->clear();
+		for (auto& chunk : this->chunks)
+			delete[] chunk.load(std::memory_order_relaxed);
+	}
+
+public:
+	void push_back(const T& item) {
+		this->emplace_back(item);
+	}
+
+	void push_back(T&& item) {
+		this->emplace_back(std::move(item));
+	}
+
+	template <typename... Args>
+	void emplace_back(Args&&... args) {
+		node* n = this->allocateNode();
+		new (&n->storage) T(std::forward<Args>(args)...);
+
+		this->nCount.fetch_add(1, std::memory_order_relaxed);
+		node* prev = this->head.exchange(n, std::memory_order_seq_cst);
+		prev->next.store(n, std::memory_order_release);
+
+		// Only the producer that takes the flag wakes the consumer
+		if (this->consumerParked.load(std::memory_order_seq_cst) && this->consumerParked.exchange(false, std::memory_order_seq_cst)) {
+			std::unique_lock<std::mutex> ul(this->muxBlocking);
+			this->blocking.notify_one();
+		}
+	}
+
+	/// <summary>
+	/// CONSUMER - Oldest element, the queue must not be empty.
+	/// </summary>
+	/// <returns></returns>
+	T& front() {
+		return *this->nextNode()->value();
+	}
+
+	/// <summary>
+	/// CONSUMER - Removes and returns the oldest element, the queue must not be empty.
+	/// </summary>
+	/// <returns></returns>
+	T pop_front() {
+		node* next = this->nextNode();
+		T item = std::move(*next->value());
+		next->value()->~T();
+
+		this->releaseNode(this->tail);
+		this->tail = next;
+		this->nCount.fetch_sub(1, std::memory_order_relaxed);
+		return item;
+	}
+
+	bool empty() {
+		return this->head.load(std::memory_order_seq_cst) == this->tail;
+	}
+
+	/// <summary>
+	/// Number of queued elements, only exact when no producer is pushing.
+	/// </summary>
+	/// <returns></returns>
+	size_t count() {
+		return this->nCount.load(std::memory_order_relaxed);
+	}
+
+	/// <summary>
+	/// CONSUMER - Moves up to maxItems elements from the front of the queue to the back of out.
+	/// </summary>
+	/// <param name="out"></param>
+	/// <param name="maxItems"></param>
+	/// <returns>Number of elements moved</returns>
+	size_t pop_all(std::vector<T>& out, size_t maxItems = size_t(-1)) {
+		size_t n = 0;
+		while (n < maxItems && !this->empty()) {
+			out.push_back(this->pop_front());
+			n++;
+		}
+		return n;
+	}
+
+	/// <summary>
+	/// CONSUMER - Removes all elements.
+	/// </summary>
+	void clear() {
+		while (!this->empty())
+			this->pop_front();
+	}
+
+	/// <summary>
+	/// CONSUMER - Blocks until the queue holds at least one element.
+	/// </summary>
+	void wait() {
+		if (!this->empty()) return;
+		this->flushReleased();
+
+		std::unique_lock<std::mutex> ul(this->muxBlocking);
+		while (true) {
+			// Set again after every wake up, a producer may have taken it late, from an earlier wait
+			this->consumerParked.store(true, std::memory_order_seq_cst);
+			if (!this->empty()) break;
+			this->blocking.wait(ul);
+		}
+		this->consumerParked.store(false, std::memory_order_relaxed);
+	}
+
+private:
+	struct node {
+		std::atomic<node*> next{ nullptr };
+		std::atomic<uint32_t> nextFree{ 0 };		// Index + 1 of the next node on the free list, 0 ends it
+		uint32_t index = 0;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+		inline T* value() { return reinterpret_cast<T*>(&this->storage); }
+	};
+
+	static constexpr uint64_t tagUnit = uint64_t(1) << 32;	// freeTop holds a tag in the high half and the index + 1 of the top node in the low half
+
+	/// <summary>
+	/// Locates a node by index. Chunks are never freed while the queue lives, so this
+	/// is safe for any index that was handed out, even one another thread took since.
+	/// </summary>
+	node* nodeAt(uint32_t index) {
+		size_t q = index / firstChunkNodes + 1;
+		size_t c = 0;
+		while (q >>= 1) c++;
+		return &this->chunks[c].load(std::memory_order_acquire)[index - firstChunkNodes * ((size_t(1) << c) - 1)];
+	}
+
+	/// <summary>
+	/// PRODUCER - Takes a node off the free list, or from a new chunk when the list is empty.
+	/// </summary>
+	node* allocateNode() {
+		uint64_t top = this->freeTop.load(std::memory_order_acquire);
+		while (uint32_t(top) != 0) {
+			node* n = this->nodeAt(uint32_t(top) - 1);
+			uint64_t next = (top & ~(tagUnit - 1)) + tagUnit + n->nextFree.load(std::memory_order_relaxed);
+			if (this->freeTop.compare_exchange_weak(top, next, std::memory_order_acquire, std::memory_order_acquire)) {
+				n->next.store(nullptr, std::memory_order_relaxed);
+				return n;
+			}
+		}
+
+		size_t c = this->nChunks.fetch_add(1, std::memory_order_relaxed);
+		if (c >= maxChunks) throw std::bad_alloc();
+
+		size_t count = firstChunkNodes << c;
+		size_t first = firstChunkNodes * ((size_t(1) << c) - 1);
+		node* chunk = new node[count];
+		for (size_t i = 0; i < count; i++) {
+			chunk[i].index = uint32_t(first + i);
+			chunk[i].nextFree.store(i + 1 < count ? uint32_t(first + i + 2) : 0, std::memory_order_relaxed);
+		}
+		this->chunks[c].store(chunk, std::memory_order_release);
+
+		// Keeps the first node, the rest goes on the free list
+		this->pushFree(&chunk[1], &chunk[count - 1]);
+		return &chunk[0];
+	}
+
+	/// <summary>
+	/// Puts a chain of nodes linked through nextFree on the free list.
+	/// </summary>
+	void pushFree(node* first, node* last) {
+		uint64_t top = this->freeTop.load(std::memory_order_relaxed);
+		do {
+			last->nextFree.store(uint32_t(top), std::memory_order_relaxed);
+		} while (!this->freeTop.compare_exchange_weak(top, (top & ~(tagUnit - 1)) + tagUnit + first->index + 1,
+			std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	/// <summary>
+	/// CONSUMER - Collects a consumed node, the nodes go back to the free list once per freeBatch.
+	/// </summary>
+	void releaseNode(node* n) {
+		n->nextFree.store(this->releasedFirst ? this->releasedFirst->index + 1 : 0, std::memory_order_relaxed);
+		if (!this->releasedLast) this->releasedLast = n;
+		this->releasedFirst = n;
+		if (++this->nReleased >= freeBatch)
+			this->flushReleased();
+	}
+
+	/// <summary>
+	/// CONSUMER - Hands the collected nodes back to the producers.
+	/// </summary>
+	void flushReleased() {
+		if (!this->releasedFirst) return;
+		this->pushFree(this->releasedFirst, this->releasedLast);
+		this->releasedFirst = nullptr;
+		this->releasedLast = nullptr;
+		this->nReleased = 0;
+	}
+
+	/// <summary>
+	/// The node after the consumed tail. A producer may have swapped the head but not
+	/// linked its node yet, in that case wait the few instructions until it does.
+	/// </summary>
+	node* nextNode() {
+		node* next = this->tail->next.load(std::memory_order_acquire);
+		while (next == nullptr) {
+			std::this_thread::yield();
+			next = this->tail->next.load(std::memory_order_acquire);
+		}
+		return next;
+	}
+
+private:
+	std::atomic<node*> head;				// Last pushed node, producers swap themselves in here
+	node* tail = nullptr;					// Already consumed node, its successor is the front - CONSUMER ONLY
+	std::atomic<size_t> nCount{ 0 };
+private:
+	std::atomic<uint64_t> freeTop{ 0 };		// Tagged top of the free list, see tagUnit
+	std::atomic<node*> chunks[maxChunks] = {};
+	std::atomic<size_t> nChunks{ 0 };
+	node* releasedFirst = nullptr;			// Consumed nodes not handed back yet - CONSUMER ONLY
+	node* releasedLast = nullptr;
+	size_t nReleased = 0;
+private:
+	std::atomic<bool> consumerParked{ false };
+	std::condition_variable blocking;
+	std::mutex muxBlocking;
+public:
+	mpsc_queue<T>& operator = (const mpsc_queue<T>&) = delete;
+};
+
+END_NET_NS
+
+#endif
\ No newline at end of file
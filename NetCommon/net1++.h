@@ -20,9 +20,18 @@
 
 #include "net_common.h"
 #include "message.h"
+#include "message_view.h"
 #include "connection.h"
+#include "client_group.h"
 #include "client.h"
 #include "server.h"
 #include "tsqueue.h"
+#include "mpsc_queue.h"
+#include "buffer_pool.h"
+#include "message_body.h"
+#include "slot_map.h"
+#include "timing_wheel.h"
+#include "token_bucket.h"
+#include "codel.h"
 
 #endif
\ No newline at end of file
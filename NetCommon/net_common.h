@@ -28,13 +28,20 @@
 #include <iostream>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <vector>
+#include <array>
 #include <chrono>
 #include <algorithm>
 #include <queue>
 #include <deque>
 #include <functional>
+#include <future>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <cstring>
 
 #ifdef _WIN32
 #   define _WIN32_WINNT 0x0A00
@@ -56,6 +63,70 @@ using scope = std::unique_ptr<T>;
 template <typename T>
 using ref = std::shared_ptr<T>;
 
+/// <summary>
+/// Restricts a thread to a single core.
+/// </summary>
+/// <param name="thread"></param>
+/// <param name="core">Wraps around the number of cores</param>
+/// <returns>False if the platform does not support it or the call failed</returns>
+inline bool pinThreadToCore(std::thread& thread, size_t core) {
+	core %= std::max(1u, std::thread::hardware_concurrency());
+#if defined(_WIN32)
+	return SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << core) != 0;
+#elif defined(__linux__)
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(core, &cpus);
+	return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpus) == 0;
+#else
+	return false;
+#endif
+}
+
+/// <summary>
+/// Name of the event demultiplexer asio was built on.
+/// </summary>
+/// <returns></returns>
+inline const char* ioBackend() {
+#if defined(ASIO_HAS_IO_URING_AS_DEFAULT)
+	return "io_uring";
+#elif defined(ASIO_HAS_IOCP)
+	return "iocp";
+#elif defined(ASIO_HAS_EPOLL)
+	return "epoll";
+#elif defined(ASIO_HAS_KQUEUE)
+	return "kqueue";
+#elif defined(ASIO_HAS_DEV_POLL)
+	return "/dev/poll";
+#else
+	return "select";
+#endif
+}
+
+/// <summary>
+/// Runs an asio context until it is stopped or runs out of work. With a spin time above zero
+/// the thread keeps polling for ready handlers until that long has passed without one and only
+/// then blocks in the kernel, trading a busy core for the wake-up latency of a sleeping thread.
+/// </summary>
+/// <param name="context"></param>
+/// <param name="spin">Zero blocks right away, like io_context::run()</param>
+inline void runContext(asio::io_context& context, std::chrono::nanoseconds spin) {
+	if (spin.count() <= 0) {
+		context.run();
+		return;
+	}
+
+	using clock = std::chrono::steady_clock;
+	while (!context.stopped()) {
+		clock::time_point lastWork = clock::now();
+		while (clock::now() - lastWork < spin) {
+			if (context.poll() > 0) lastWork = clock::now();
+			if (context.stopped()) return;
+		}
+		context.run_one();
+	}
+}
+
 END_NET_NS
 
 #endif
\ No newline at end of file
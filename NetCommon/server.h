@@ -22,16 +22,121 @@
 #include "tsqueue.h"
 #include "message.h"
 #include "connection.h"
+#include "slot_map.h"
+#include "timing_wheel.h"
+#include "codel.h"
+#include <unordered_map>
+
+// Socket option under which the kernel spreads the connections of a port over every socket
+// listening on it. Linux balances SO_REUSEPORT listeners and FreeBSD SO_REUSEPORT_LB ones,
+// elsewhere (macOS, the other BSDs) SO_REUSEPORT hands every connection to a single listener.
+#if defined(__linux__) && defined(SO_REUSEPORT)
+#   define NET_BALANCED_REUSEPORT SO_REUSEPORT
+#elif defined(SO_REUSEPORT_LB)
+#   define NET_BALANCED_REUSEPORT SO_REUSEPORT_LB
+#endif
 
 BEGIN_NET_NS
 
+/// <summary>
+/// How update() picks the messages it dispatches.
+/// fifo - in the order they arrived over all clients of a shard, the shards in turn. A client
+///        that sends a lot takes up most of every update(maxMessages) budget.
+/// fair - every client has a queue of its own, update() takes from them in deficit round robin.
+///        Each turn a client may dispatch server_options::fairQuantum bytes times its inbound
+///        weight, so a client that sends a lot only delays its own messages.
+/// </summary>
+enum class inbound_scheduling {
+	fifo,
+	fair
+};
+
+/// <summary>
+/// Tunables of a server, handed to the server on construction.
+/// </summary>
+struct server_options {
+	size_t ioThreads = 1;						// Threads running each shard's asio context, each connection stays serialized on its own strand
+	size_t shards = 1;							// Independent asio contexts, each with its own threads, acceptor and connections
+	bool pinThreads = false;					// Pin every asio thread to its own core
+	size_t acceptsInFlight = 1;					// Accepts kept pending on every acceptor, the asio threads of the shard complete them in parallel
+	int listenBacklog = asio::socket_base::max_listen_connections;	// Connections the kernel queues for an acceptor before refusing them
+	std::chrono::microseconds busyPoll{ 0 };	// Asio threads spin this long without work before they block, see runContext
+
+	dispatch_mode dispatchMode = dispatch_mode::serial;	// See dispatch_mode
+	size_t dispatchThreads = 0;					// Threads calling onMessage in parallel dispatch mode, 0 uses one per core
+	size_t maxDispatchInFlight = 4096;			// Messages handed to the dispatch threads that onMessage did not finish yet, update() takes no more until they drop below, 0 is unlimited
+
+	std::chrono::milliseconds timerTick{ 10 };			// Resolution of the timeouts, heartbeats and delayed sends
+	std::chrono::milliseconds handshakeTimeout{ 0 };	// Disconnect clients that did not pass the handshake in time, 0 disables
+	std::chrono::milliseconds readIdleTimeout{ 0 };		// Disconnect clients nothing was read from for this long, 0 disables
+	std::chrono::milliseconds heartbeatInterval{ 0 };	// Send the heartbeat message to clients nothing was sent to for this long, 0 disables
+
+	rate_limit inboundLimit;					// Shared by all clients, every client pauses reading while it is exceeded
+
+	inbound_scheduling inboundScheduling = inbound_scheduling::fifo;	// See inbound_scheduling, not used in inline dispatch mode
+	size_t fairQuantum = 4096;					// Bytes a client of weight 1 may dispatch per turn in fair inbound scheduling
+
+	std::chrono::microseconds sheddingTarget{ 0 };		// Longest time messages may keep waiting in the inbound queue before update() sheds them, 0 disables, see codel
+	std::chrono::milliseconds sheddingInterval{ 100 };	// How long the wait has to stay above target before shedding starts, and the longest wait of a sheddable message
+};
+
+/// <summary>
+/// A shard is an asio context with the threads that run it, an acceptor and the connections
+/// accepted on it. Shards share nothing on the read and write path. Where the kernel balances
+/// listeners sharing a port (Linux SO_REUSEPORT, FreeBSD SO_REUSEPORT_LB) every shard listens
+/// on the port itself and the kernel spreads the incoming connections, elsewhere the first
+/// shard accepts for all shards in turn.
+/// </summary>
+/// <typeparam name="T"> = User defined enum-class </typeparam>
+template <typename T>
+struct server_shard {
+	static constexpr uint32_t clientIndexBits = 20;	// Low bits of a client ID locate its slot, the rest holds the generation
+
+	server_shard(std::chrono::milliseconds timerTick) : timers(timerTick) {}
+
+	asio::io_context context;						// Declared first so it outlives the connections
+	asio::executor_work_guard<asio::io_context::executor_type> work = asio::make_work_guard(context);	// Keeps run() going while the shard has no connections
+	asio::strand<asio::io_context::executor_type> acceptStrand = asio::make_strand(context);	// Serializes the use of the acceptor
+	asio::steady_timer tickTimer{ context };		// Advances the timing wheel
+	timing_wheel timers;							// Timeouts, heartbeats and delayed sends of the shard's connections
+	std::vector<std::thread> vecThreads;
+	scope<asio::ip::tcp::acceptor> acceptor;		// Null when another shard accepts for this one
+
+	inbound_queue<owned_message<T>> qMessagesIn;	// Messages received by the shard's connections, drained by update()
+
+	std::mutex muxConnections;						// Guards the connections, taken by accepts and by sends from the user
+	slot_map<ref<connection<T>>, 32 - clientIndexBits> connections;	// Active validated connections, keyed by client ID
+
+	size_t index = 0;
+};
+
 template <typename T>
 class server_interface {
 public:
-	server_interface(uint16_t port) 
-		: asioAcceptor(context, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
-	{}
+	server_interface(uint16_t port, const server_options& options = {}) 
+		: options(options), inboundLimiter(options.inboundLimit)
+	{
+		asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port);
+		size_t shards = std::max<size_t>(1, this->options.shards);
+
+		for (size_t i = 0; i < shards; i++) {
+			this->vecShards.push_back(std::make_unique<server_shard<T>>(this->options.timerTick));
+			this->vecShards.back()->index = i;
+		}
+
+#ifdef NET_BALANCED_REUSEPORT
+		for (auto& shard : this->vecShards)
+			shard->acceptor = this->listen(shard->context, endpoint, shards > 1);
+#else
+		this->vecShards.front()->acceptor = this->listen(this->vecShards.front()->context, endpoint, false);
+#endif
+	}
 
+	/// <summary>
+	/// Stops the server if it still runs. By then the derived server is already destroyed while
+	/// the asio threads may still call its hooks, so a derived server has to call stop() in its
+	/// own destructor.
+	/// </summary>
 	virtual ~server_interface() {
 		this->stop();
 	}
@@ -44,9 +149,28 @@ public:
 	/// <returns>bool</returns>
 	bool start() {
 		try {
-			this->waitForClientConnection();
+			if (this->options.dispatchMode == dispatch_mode::parallel && !this->dispatchPool) {
+				size_t threads = this->options.dispatchThreads > 0
+					? this->options.dispatchThreads
+					: std::max(1u, std::thread::hardware_concurrency());
+				this->dispatchPool = std::make_unique<asio::thread_pool>(threads);
+			}
 
-			this->threadContext = std::thread([this]() { context.run(); });
+			for (auto& shard : this->vecShards) {
+				if (shard->acceptor)
+					for (size_t i = 0; i < std::max<size_t>(1, this->options.acceptsInFlight); i++)
+						asio::post(shard->acceptStrand, [this, &shard = *shard]() { waitForClientConnection(shard); });
+				this->tickTimers(*shard);
+			}
+
+			size_t core = 0;
+			for (auto& shard : this->vecShards)
+				for (size_t i = 0; i < std::max<size_t>(1, this->options.ioThreads); i++) {
+					asio::io_context& context = shard->context;
+					shard->vecThreads.emplace_back([&context, spin = this->options.busyPoll]() { runContext(context, spin); });
+					if (this->options.pinThreads)
+						pinThreadToCore(shard->vecThreads.back(), core++);
+				}
 		}
 		catch (std::exception& e) {
 			std::cerr << "[SERVER] Exception: " << e.what() << "\n";
@@ -61,41 +185,55 @@ public:
 	/// Stops the server.
 	/// </summary>
 	void stop() {
-		this->context.stop();
-		if (this->threadContext.joinable()) this->threadContext.join();
+		for (auto& shard : this->vecShards)
+			shard->context.stop();
+
+		for (auto& shard : this->vecShards) {
+			for (std::thread& thread : shard->vecThreads)
+				if (thread.joinable()) thread.join();
+			shard->vecThreads.clear();
+		}
+
+		if (this->dispatchPool)
+			this->dispatchPool->join();
 		std::cout << "[SERVER] Stopped!\n";
 	}
 
 	/// <summary>
-	/// ASYNC - Instruct asio to wait for conenction.
+	/// Sets the options used for connections accepted from now on.
 	/// </summary>
-	void waitForClientConnection() {
-		this->asioAcceptor.async_accept(
-			[this](std::error_code ec, asio::ip::tcp::socket socket) {
-				if (!ec) {
-					std::cout << "[SERVER] New Connection: " << socket.remote_endpoint() << "\n";
+	/// <param name="options"></param>
+	void setConnectionOptions(const connection_options& options) {
+		this->connOptions = options;
+	}
 
-					ref<connection<T>> newconn =
-						std::make_shared<connection<T>>(
-								connection<T>::owner::server,
-								context,
-								std::move(socket),
-								qMessagesIn
-							);
+	/// <summary>
+	/// ASYNC - Instruct asio to wait for conenction on the acceptor of a shard. Shards without
+	/// an acceptor of their own take turns receiving the connections of the first shard.
+	/// Accepts are started and completed on the shard's accept strand, as the acceptor may only
+	/// be used by one thread at a time. Every accept re-arms itself and then sets up its
+	/// connection on the context of the target shard, off the strand, so with
+	/// server_options::acceptsInFlight above 1 several connections are set up at once and
+	/// onClientConnect may run on more than one thread.
+	/// </summary>
+	void waitForClientConnection(server_shard<T>& shard) {
+		server_shard<T>& target = shard.index == 0 && !this->vecShards.back()->acceptor
+			? *this->vecShards[this->nNextShard++ % this->vecShards.size()]
+			: shard;
 
-					if (onClientConnect(newconn)) {
-						deqConnections.push_back(std::move(newconn));
-						deqConnections.back()->connectToClient(this, cIDCounter++);
-						std::cout << '[' << deqConnections.back()->getID() << "] Connection Approved\n";
-					}
-					else
-						std::cout << "[SERVER] Connection Denied!\n";
-				}
+		shard.acceptor->async_accept(
+			target.context,
+			asio::bind_executor(shard.acceptStrand, [this, &shard, &target](std::error_code ec, asio::ip::tcp::socket socket) {
+				if (ec == asio::error::operation_aborted) return;
+				this->waitForClientConnection(shard);
+
+				if (!ec)
+					asio::post(target.context, [this, &target, socket = std::move(socket)]() mutable {
+						this->acceptClient(target, std::move(socket));
+					});
 				else
 					std::cout << "[SERVER] New Connection Error: " << ec.message() << "\n";
-
-				this->waitForClientConnection();
-			}
+			})
 		);
 	}
 
@@ -104,18 +242,23 @@ public:
 	/// </summary>
 	/// <param name="client"></param>
 	/// <param name="msg"></param>
-	void messageClient(ref<connection<T>> client, const message<T>& msg) {
+	send_status messageClient(ref<connection<T>> client, const message<T>& msg) {
+		return this->messageClient(std::move(client), message<T>(msg));
+	}
+
+	/// <summary>
+	/// Send message to a specific client, the body is moved without a copy.
+	/// </summary>
+	/// <param name="client"></param>
+	/// <param name="msg"></param>
+	send_status messageClient(ref<connection<T>> client, message<T>&& msg) {
 		if (client && client->isConnected()) {
-			client->send(msg);
+			return client->send(std::move(msg));
 		}
 		else {
-			this->onClientDisconnect(client);
-			client.reset();
-			this->deqConnections.erase(
-					std::remove(deqConnections.begin(), deqConnections.end(), client), 
-					this->deqConnections.end()
-				);
-
+			if (!client || this->removeClient(client->getID()))
+				this->onClientDisconnect(client);
+			return send_status::disconnected;
 		}
 	}
 
@@ -125,40 +268,534 @@ public:
 	/// <param name="msg"></param>
 	/// <param name="client"></param>
 	void messageAllClients(const message<T>& msg, ref<connection<T>> ignoreClient = nullptr) {
-		int8_t invalidClientExists = 0;
+		this->messageAllClients(shared_message<T>(msg), ignoreClient);
+	}
 
-		for (auto& client : this->deqConnections) {
-			if (client && client->isConnected()) {
-				if (client != ignoreClient)
-					client->send(msg);
-			}
-			else {
-				this->onClientDisconnect(client);
-				client.reset();
-				invalidClientExists = 1;
+	/// <summary>
+	/// Send a message to all of the clients, the body is moved without a copy.
+	/// </summary>
+	/// <param name="msg"></param>
+	/// <param name="client"></param>
+	void messageAllClients(message<T>&& msg, ref<connection<T>> ignoreClient = nullptr) {
+		this->messageAllClients(shared_message<T>(std::move(msg)), ignoreClient);
+	}
+
+	/// <summary>
+	/// Send an encoded message to all of the clients, every client references the same bytes.
+	/// </summary>
+	/// <param name="msg"></param>
+	/// <param name="client"></param>
+	void messageAllClients(const shared_message<T>& msg, ref<connection<T>> ignoreClient = nullptr) {
+		std::vector<ref<connection<T>>> vecInvalidClients;
+		std::vector<ref<connection<T>>> vecTargets;
+
+		for (auto& shard : this->vecShards) {
+			// Only copy the clients under the lock, send can call onClientHighWatermark
+			{
+				std::scoped_lock<std::mutex> lock(shard->muxConnections);
+				size_t nInvalidClients = vecInvalidClients.size();
+				vecTargets.reserve(shard->connections.size());
+
+				for (auto& client : shard->connections) {
+					if (client->isConnected()) {
+						if (client != ignoreClient)
+							vecTargets.push_back(client);
+					}
+					else
+						vecInvalidClients.push_back(client);
+				}
+
+				// Closed, but the close has not been reported yet
+				for (size_t i = nInvalidClients; i < vecInvalidClients.size(); i++)
+					shard->connections.erase(this->clientKey(vecInvalidClients[i]->getID()));
 			}
+
+			for (auto& client : vecTargets)
+				client->send(msg);
+			vecTargets.clear();
 		}
 
-		if (invalidClientExists)
-			this->deqConnections.erase(
-				std::remove(deqConnections.begin(), deqConnections.end(), nullptr),
-				this->deqConnections.end()
-			);
+		for (auto& client : vecInvalidClients)
+			this->onClientDisconnect(client);
+	}
+
+	/// <summary>
+	/// Sends a message to a client after a delay, if it is still connected by then.
+	/// </summary>
+	/// <param name="client"></param>
+	/// <param name="msg"></param>
+	/// <param name="delay"></param>
+	/// <returns>Handle for cancelDelayedMessage</returns>
+	slot_key messageClientAfter(ref<connection<T>> client, message<T> msg, std::chrono::milliseconds delay) {
+		std::weak_ptr<connection<T>> weak = client;
+		return this->shardOf(client->getID()).timers.schedule(
+			delay,
+			[weak, msg = shared_message<T>(std::move(msg))]() {
+				if (auto client = weak.lock(); client && client->isConnected())
+					client->send(msg);
+			});
+	}
+
+	/// <summary>
+	/// Cancels a message scheduled with messageClientAfter.
+	/// </summary>
+	/// <param name="client"></param>
+	/// <param name="timer"></param>
+	/// <returns>False if the message was already sent or cancelled</returns>
+	bool cancelDelayedMessage(ref<connection<T>> client, slot_key timer) {
+		return this->shardOf(client->getID()).timers.cancel(timer);
+	}
+
+	/// <summary>
+	/// Message sent to clients when server_options::heartbeatInterval passed without any
+	/// other message to them. Set it before starting the server.
+	/// </summary>
+	/// <param name="msg"></param>
+	void setHeartbeatMessage(const message<T>& msg) {
+		this->heartbeat = shared_message<T>(msg);
+	}
+
+	/// <summary>
+	/// Looks up a connected client.
+	/// </summary>
+	/// <param name="id"></param>
+	/// <returns>The client, nullptr if no client has this ID anymore</returns>
+	ref<connection<T>> getClient(uint32_t id) {
+		server_shard<T>& shard = this->shardOf(id);
+		std::scoped_lock<std::mutex> lock(shard.muxConnections);
+		ref<connection<T>>* client = shard.connections.find(this->clientKey(id));
+		return client ? *client : nullptr;
 	}
 
 	/// <summary>
-	/// Updates the server input with incomming message packets in the global thread safe queue.
+	/// Messages shed by the inbound queue management, in total or of one message ID.
+	/// </summary>
+	/// <returns></returns>
+	inline uint64_t getShedMessages() const { return this->nShed; }
+
+	uint64_t getShedMessages(T id) {
+		std::scoped_lock<std::mutex> lock(this->muxShed);
+		auto it = this->mapShed.find(uint32_t(id));
+		return it != this->mapShed.end() ? it->second : 0;
+	}
+
+	/// <summary>
+	/// Updates the server input with incomming message packets in the inbound queues of the shards.
+	/// Up to maxMessages are taken from the queues as one batch, starting at the next shard every
+	/// call, and then dispatched, in parallel
+	/// dispatch mode the batch is handed to the dispatch threads and update() returns right away,
+	/// and the batch is cut to what fits below server_options::maxDispatchInFlight.
+	/// While that is reached update() dispatches nothing, or waits for room if wait is set.
+	/// In fair inbound scheduling everything that arrived is sorted into the queues of the
+	/// clients first, and the batch is taken from those, see inbound_scheduling.
+	/// Not needed in inline dispatch mode, the queues stay empty and waiting on them never returns.
+	/// An exception thrown by onMessage leaves update(), the message it threw on is not handed
+	/// out again and the rest of the batch goes first on the next call. In parallel dispatch
+	/// mode the dispatch thread catches it, and the next update() throws the first one caught
+	/// since the previous call before it takes any message, the others are dropped.
+	/// Call it from one thread at a time.
 	/// </summary>
 	/// <param name="maxMessages"></param>
 	void update(size_t maxMessages = -1, int8_t wait = 0) {
-		if (wait) this->qMessagesIn.wait();
+		this->rethrowDispatchError();
+		maxMessages = std::min(maxMessages, this->dispatchCapacity(wait));
+
+		if (this->options.inboundScheduling == inbound_scheduling::fair) {
+			this->updateFair(maxMessages, wait);
+			return;
+		}
+
+		// Messages left behind by an onMessage that threw go first
+		size_t nLeft = this->vecIncomingBatch.size();
+		if (wait && nLeft == 0) this->waitForIncoming();
+		if (maxMessages > nLeft)
+			this->takeIncoming(maxMessages - nLeft);
 
-		size_t messageCounter = 0;
-		while (messageCounter < maxMessages && !this->qMessagesIn.empty()) {
-			auto msg = this->qMessagesIn.pop_front();
+		size_t nBatch = std::min(maxMessages, this->vecIncomingBatch.size());
+		size_t nDone = 0;
+		try {
+			while (nDone < nBatch) {
+				owned_message<T>& msg = this->vecIncomingBatch[nDone++];
+				if (!this->shed(this->inboundCodel, msg))
+					this->dispatch(msg);
+			}
+		}
+		catch (...) {
+			this->vecIncomingBatch.erase(this->vecIncomingBatch.begin(), this->vecIncomingBatch.begin() + nDone);
+			throw;
+		}
+
+		this->vecIncomingBatch.erase(this->vecIncomingBatch.begin(), this->vecIncomingBatch.begin() + nDone);
+	}
+
+private:
+	/// <summary>
+	/// Sets up the connection of an accepted socket and asks onClientConnect whether to keep it.
+	/// </summary>
+	/// <param name="target">Shard the socket belongs to</param>
+	/// <param name="socket"></param>
+	void acceptClient(server_shard<T>& target, asio::ip::tcp::socket socket) {
+		std::error_code ecEndpoint;
+		std::cout << "[SERVER] New Connection: " << socket.remote_endpoint(ecEndpoint) << "\n";
+
+		ref<connection<T>> newconn =
+			std::make_shared<connection<T>>(
+					connection<T>::owner::server,
+					target.context,
+					std::move(socket),
+					target.qMessagesIn,
+					this->connOptions
+				);
+
+		if (this->dispatchPool)
+			newconn->setDispatchExecutor(asio::make_strand(this->dispatchPool->get_executor()));
+		else if (this->options.dispatchMode == dispatch_mode::inline_io)
+			newconn->setMessageHandler([this, conn = newconn.get()](message<T>& msg) {
+				onMessage(conn->shared_from_this(), msg);
+			});
+
+		uint32_t id = this->onClientConnect(newconn) ? this->addClient(target, newconn) : 0;
+		if (id != 0) {
+			this->armClientTimers(target, newconn);
+			newconn->connectToClient(this, id);
+			std::cout << '[' << newconn->getID() << "] Connection Approved\n";
+		}
+		else
+			std::cout << "[SERVER] Connection Denied!\n";
+	}
+
+	/// <summary>
+	/// Hands a message to onMessage, or to the dispatch threads in parallel dispatch mode.
+	/// </summary>
+	/// <param name="msg"></param>
+	void dispatch(owned_message<T>& msg) {
+		if (this->dispatchPool && msg.getRemote()) {
+			const asio::any_io_executor& executor = msg.getRemote()->getDispatchExecutor();
+			this->nDispatchInFlight++;
+			asio::post(executor, [this, msg = std::move(msg)]() mutable {
+				// An exception would end the dispatch thread, the next update() throws it instead
+				try {
+					onMessage(msg.getRemote(), msg.getMsg());
+				}
+				catch (...) {
+					std::scoped_lock<std::mutex> lock(this->muxDispatch);
+					if (!this->dispatchError)
+						this->dispatchError = std::current_exception();
+					this->hasDispatchError = true;
+				}
+
+				// Wake an update() waiting for room when this one makes it
+				if (this->nDispatchInFlight-- == this->options.maxDispatchInFlight) {
+					std::scoped_lock<std::mutex> lock(this->muxDispatch);
+					this->dispatchRoom.notify_one();
+				}
+			});
+		}
+		else
 			this->onMessage(msg.getRemote(), msg.getMsg());
-			messageCounter++;
+	}
+
+	/// <summary>
+	/// Throws the first exception a dispatch thread caught from onMessage since the last call.
+	/// </summary>
+	void rethrowDispatchError() {
+		if (!this->hasDispatchError) return;
+
+		std::exception_ptr error;
+		{
+			std::scoped_lock<std::mutex> lock(this->muxDispatch);
+			std::swap(error, this->dispatchError);
+			this->hasDispatchError = false;
 		}
+		if (error) std::rethrow_exception(error);
+	}
+
+	/// <summary>
+	/// Messages update() may still hand to the dispatch threads in parallel dispatch mode,
+	/// unlimited in the other modes.
+	/// </summary>
+	/// <param name="wait">Block until there is room instead of returning 0</param>
+	/// <returns></returns>
+	size_t dispatchCapacity(bool wait) {
+		size_t limit = this->options.maxDispatchInFlight;
+		if (!this->dispatchPool || limit == 0) return size_t(-1);
+
+		if (wait && this->nDispatchInFlight >= limit) {
+			std::unique_lock<std::mutex> lock(this->muxDispatch);
+			this->dispatchRoom.wait(lock, [&]() { return this->nDispatchInFlight < limit; });
+		}
+
+		size_t inFlight = this->nDispatchInFlight;
+		return inFlight < limit ? limit - inFlight : 0;
+	}
+
+	/// <summary>
+	/// Drops a message leaving the inbound queue when the queue's codel asks for it and the
+	/// message may be shed.
+	/// </summary>
+	/// <param name="aqm"></param>
+	/// <param name="msg"></param>
+	/// <returns>True if the message was dropped</returns>
+	bool shed(codel& aqm, owned_message<T>& msg) {
+		if (!aqm.enabled()) return false;
+
+		codel::clock::time_point now = codel::clock::now();
+		if (!aqm.shouldDrop(now - msg.getReceived(), now) || !this->canShedMessage(msg.getRemote(), msg.getMsg()))
+			return false;
+
+		{
+			std::scoped_lock<std::mutex> lock(this->muxShed);
+			this->mapShed[uint32_t(msg.getMsg().getHeader().id)]++;
+		}
+		this->nShed++;
+		this->onMessageShed(msg.getRemote(), msg.getMsg());
+		return true;
+	}
+
+	/// <summary>
+	/// Moves up to maxMessages from the shards' inbound queues to vecIncomingBatch. Every call
+	/// starts at the next shard, so a budget that runs out early does not always favour the first.
+	/// </summary>
+	/// <param name="maxMessages"></param>
+	void takeIncoming(size_t maxMessages) {
+		size_t nShards = this->vecShards.size();
+		size_t nTaken = 0;
+		for (size_t i = 0; i < nShards && nTaken < maxMessages; i++)
+			nTaken += this->vecShards[(this->nNextDrainShard + i) % nShards]->qMessagesIn.pop_all(this->vecIncomingBatch, maxMessages - nTaken);
+		this->nNextDrainShard = (this->nNextDrainShard + 1) % nShards;
+	}
+
+	/// <summary>
+	/// Blocks until any shard received a message, see notifyIncoming.
+	/// </summary>
+	void waitForIncoming() {
+		std::unique_lock<std::mutex> ul(this->muxIncoming);
+		while (true) {
+			// Set again after every wake up, a connection may have taken it late, from an earlier wait
+			this->updateParked.store(true, std::memory_order_seq_cst);
+			for (auto& shard : this->vecShards)
+				if (!shard->qMessagesIn.empty()) {
+					this->updateParked.store(false, std::memory_order_relaxed);
+					return;
+				}
+			this->incomingReady.wait(ul);
+		}
+	}
+
+	/// <summary>
+	/// update() in fair inbound scheduling. A client whose turn the budget ran out in keeps its
+	/// turn and its deficit for the next call. Every client queue sheds on its own, so only the
+	/// clients that build up a backlog lose messages.
+	/// </summary>
+	/// <param name="maxMessages"></param>
+	/// <param name="wait"></param>
+	void updateFair(size_t maxMessages, int8_t wait) {
+		if (wait && this->deqActiveFlows.empty()) this->waitForIncoming();
+
+		this->takeIncoming(size_t(-1));
+		for (auto& msg : this->vecIncomingBatch) {
+			uint32_t id = msg.getRemote() ? msg.getRemote()->getID() : 0;
+			auto [flow, added] = this->mapFlows.try_emplace(id);
+			if (added) {
+				flow->second.aqm = codel(this->options.sheddingTarget, this->options.sheddingInterval);
+				this->deqActiveFlows.push_back(id);
+			}
+			flow->second.messages.push_back(std::move(msg));
+		}
+		this->vecIncomingBatch.clear();
+
+		size_t nDispatched = 0;
+		while (nDispatched < maxMessages && !this->deqActiveFlows.empty()) {
+			auto it = this->mapFlows.find(this->deqActiveFlows.front());
+			inbound_flow& flow = it->second;
+
+			// Emptied by an onMessage that threw on its last message
+			if (flow.messages.empty()) {
+				this->mapFlows.erase(it);
+				this->deqActiveFlows.pop_front();
+				continue;
+			}
+
+			if (!flow.inTurn) {
+				const ref<connection<T>>& remote = flow.messages.front().getRemote();
+				flow.deficit += std::max<size_t>(1, this->options.fairQuantum) * (remote ? remote->getInboundWeight() : 1);
+				flow.inTurn = true;
+			}
+
+			while (nDispatched < maxMessages && !flow.messages.empty()
+				&& flow.messages.front().getMsg().size() <= flow.deficit) {
+				// Off the queue before onMessage sees it, so it is not handed out again if that throws
+				owned_message<T> msg = std::move(flow.messages.front());
+				flow.messages.pop_front();
+				flow.deficit -= msg.getMsg().size();
+				nDispatched++;
+				if (!this->shed(flow.aqm, msg))
+					this->dispatch(msg);
+			}
+
+			// An emptied queue leaves the round and forgets its deficit, a queue whose next message
+			// does not fit waits for its next turn at the back
+			if (flow.messages.empty()) {
+				this->mapFlows.erase(it);
+				this->deqActiveFlows.pop_front();
+			}
+			else if (flow.messages.front().getMsg().size() > flow.deficit) {
+				flow.inTurn = false;
+				this->deqActiveFlows.push_back(this->deqActiveFlows.front());
+				this->deqActiveFlows.pop_front();
+			}
+		}
+	}
+
+	/// <summary>
+	/// Opens an acceptor listening on the endpoint.
+	/// </summary>
+	/// <param name="context"></param>
+	/// <param name="endpoint"></param>
+	/// <param name="reusePort">Allow the other shards to listen on the same port</param>
+	/// <returns></returns>
+	scope<asio::ip::tcp::acceptor> listen(asio::io_context& context, const asio::ip::tcp::endpoint& endpoint, bool reusePort) {
+		auto acceptor = std::make_unique<asio::ip::tcp::acceptor>(context);
+		acceptor->open(endpoint.protocol());
+		acceptor->set_option(asio::socket_base::reuse_address(true));
+#ifdef NET_BALANCED_REUSEPORT
+		if (reusePort)
+			acceptor->set_option(asio::detail::socket_option::boolean<SOL_SOCKET, NET_BALANCED_REUSEPORT>(true));
+#endif
+		acceptor->bind(endpoint);
+		acceptor->listen(this->options.listenBacklog);
+		return acceptor;
+	}
+
+	/// <summary>
+	/// ASYNC - Advances the timing wheel of a shard on every tick.
+	/// </summary>
+	/// <param name="shard"></param>
+	void tickTimers(server_shard<T>& shard) {
+		shard.tickTimer.expires_after(shard.timers.untilNextTick());
+		shard.tickTimer.async_wait([this, &shard](std::error_code ec) {
+			if (ec) return;
+			shard.timers.advance();
+			tickTimers(shard);
+		});
+	}
+
+	/// <summary>
+	/// Starts the handshake timeout, read idle timeout and heartbeat of a new client. The timers
+	/// do not follow every read and send, they compare the connection's last read and send
+	/// times when they fire and re-arm themselves for the time that is left.
+	/// </summary>
+	/// <param name="shard"></param>
+	/// <param name="client"></param>
+	void armClientTimers(server_shard<T>& shard, const ref<connection<T>>& client) {
+		using timer = typename connection<T>::timer;
+		std::weak_ptr<connection<T>> weak = client;
+
+		if (this->options.handshakeTimeout.count() > 0)
+			client->getTimer(timer::handshake) = shard.timers.schedule(this->options.handshakeTimeout, [weak]() {
+				if (auto client = weak.lock(); client && !client->isValidated()) {
+					std::cout << "[" << client->getID() << "] Handshake Timeout\n";
+					client->disconnect();
+				}
+			});
+
+		if (this->options.readIdleTimeout.count() > 0)
+			this->watchReadIdle(shard, client, this->options.readIdleTimeout);
+
+		if (this->options.heartbeatInterval.count() > 0 && this->heartbeat)
+			this->watchSendIdle(shard, client, this->options.heartbeatInterval);
+	}
+
+	/// <summary>
+	/// Cancels the timers of a closed client, so they do not keep its memory until they fire.
+	/// </summary>
+	/// <param name="client"></param>
+	void cancelClientTimers(const ref<connection<T>>& client) {
+		timing_wheel& timers = this->shardOf(client->getID()).timers;
+		for (size_t i = 0; i < size_t(connection<T>::timer::count); i++)
+			timers.cancel(client->getTimer(typename connection<T>::timer(i)).exchange(slot_key{}));
+	}
+
+	void watchReadIdle(server_shard<T>& shard, const ref<connection<T>>& client, timing_wheel::clock::duration delay) {
+		std::weak_ptr<connection<T>> weak = client;
+		client->getTimer(connection<T>::timer::readIdle) = shard.timers.schedule(delay, [this, &shard, weak]() {
+			auto client = weak.lock();
+			if (!client || !client->isConnected()) return;
+
+			auto idle = timing_wheel::clock::now() - client->getLastRead();
+			if (idle >= this->options.readIdleTimeout) {
+				std::cout << "[" << client->getID() << "] Read Idle Timeout\n";
+				client->disconnect();
+			}
+			else
+				this->watchReadIdle(shard, client, this->options.readIdleTimeout - idle);
+		});
+	}
+
+	void watchSendIdle(server_shard<T>& shard, const ref<connection<T>>& client, timing_wheel::clock::duration delay) {
+		std::weak_ptr<connection<T>> weak = client;
+		client->getTimer(connection<T>::timer::heartbeat) = shard.timers.schedule(delay, [this, &shard, weak]() {
+			auto client = weak.lock();
+			if (!client || !client->isConnected()) return;
+
+			auto idle = timing_wheel::clock::now() - client->getLastSend();
+			if (idle >= this->options.heartbeatInterval) {
+				if (client->isValidated())
+					client->send(this->heartbeat);
+				this->watchSendIdle(shard, client, this->options.heartbeatInterval);
+			}
+			else
+				this->watchSendIdle(shard, client, this->options.heartbeatInterval - idle);
+		});
+	}
+
+	/// <summary>
+	/// Stores a new client in the slot map of its shard.
+	/// A client ID is the slot generation followed by clientIndexBits of position, where the
+	/// position interleaves the slots of all shards: slot index * shards + shard index.
+	/// </summary>
+	/// <param name="shard"></param>
+	/// <param name="client"></param>
+	/// <returns>The client ID, 0 if the shard is full</returns>
+	uint32_t addClient(server_shard<T>& shard, const ref<connection<T>>& client) {
+		std::scoped_lock<std::mutex> lock(shard.muxConnections);
+		uint64_t position = uint64_t(shard.connections.nextIndex()) * this->vecShards.size() + shard.index;
+		if (position >= (uint64_t(1) << server_shard<T>::clientIndexBits))
+			return 0;
+
+		slot_key key = shard.connections.insert(client);
+		return (key.generation << server_shard<T>::clientIndexBits) | uint32_t(position);
+	}
+
+	/// <summary>
+	/// Removes a client from its shard.
+	/// </summary>
+	/// <param name="id"></param>
+	/// <returns>False if the client was already removed</returns>
+	bool removeClient(uint32_t id) {
+		server_shard<T>& shard = this->shardOf(id);
+		std::scoped_lock<std::mutex> lock(shard.muxConnections);
+		return shard.connections.erase(this->clientKey(id));
+	}
+
+	/// <summary>
+	/// Slot map key of a client ID within its shard.
+	/// </summary>
+	/// <param name="id"></param>
+	/// <returns></returns>
+	slot_key clientKey(uint32_t id) const {
+		uint32_t position = id & ((1u << server_shard<T>::clientIndexBits) - 1);
+		return slot_key{ uint32_t(position / this->vecShards.size()), id >> server_shard<T>::clientIndexBits };
+	}
+
+	/// <summary>
+	/// Shard a client was accepted on, the shard index is part of the client ID.
+	/// </summary>
+	/// <param name="id"></param>
+	/// <returns></returns>
+	server_shard<T>& shardOf(uint32_t id) {
+		uint32_t position = id & ((1u << server_shard<T>::clientIndexBits) - 1);
+		return *this->vecShards[position % this->vecShards.size()];
 	}
 
 protected:
@@ -170,7 +807,9 @@ protected:
 	virtual bool onClientConnect(ref<connection<T>> client) { return false; }
 
 	/// <summary>
-	/// Is called when client disconnects from the server.
+	/// Is called once when a client disconnects from the server. Runs on the asio thread that
+	/// saw the socket close, or on the thread of the send that found the client closed, so it
+	/// can run at the same time as update() and onMessage on other threads.
 	/// </summary>
 	/// <param name="client"></param>
 	virtual void onClientDisconnect(ref<connection<T>> client) {}
@@ -181,24 +820,127 @@ protected:
 	/// <param name="client"></param>
 	/// <param name="msg"></param>
 	virtual void onMessage(ref<connection<T>> client, message<T>& msg) {}
+
+	/// <summary>
+	/// Whether a message may be shed when the inbound queue is overloaded, see
+	/// server_options::sheddingTarget. Messages that may not are always dispatched.
+	/// Runs on the thread calling update().
+	/// </summary>
+	/// <param name="client"></param>
+	/// <param name="msg"></param>
+	/// <returns>bool</returns>
+	virtual bool canShedMessage(ref<connection<T>> client, const message<T>& msg) { return true; }
+
+	/// <summary>
+	/// Called for every message that was shed instead of dispatched, for example to tell the
+	/// client the server is overloaded. Runs on the thread calling update().
+	/// </summary>
+	/// <param name="client"></param>
+	/// <param name="msg"></param>
+	virtual void onMessageShed(ref<connection<T>> client, message<T>& msg) {}
 public:
 	/// <summary>
-	/// Called when a client is validated.
+	/// Reported by a connection when its socket closed on a read or write error or because it
+	/// was disconnected. Removes the client and calls onClientDisconnect, unless a send already did.
+	/// </summary>
+	/// <param name="client"></param>
+	void onConnectionClosed(ref<connection<T>> client) {
+		this->cancelClientTimers(client);
+		if (this->removeClient(client->getID()))
+			this->onClientDisconnect(client);
+	}
+
+	/// <summary>
+	/// Called by a connection after it queued a message, wakes an update() waiting for one.
+	/// Only the connection that takes the flag takes the mutex.
+	/// </summary>
+	void notifyIncoming() {
+		if (this->updateParked.load(std::memory_order_seq_cst) && this->updateParked.exchange(false, std::memory_order_seq_cst)) {
+			std::scoped_lock<std::mutex> lock(this->muxIncoming);
+			this->incomingReady.notify_one();
+		}
+	}
+
+	/// <summary>
+	/// Charges a message received from any client to server_options::inboundLimit.
+	/// </summary>
+	/// <param name="bytes"></param>
+	void chargeInbound(size_t bytes) {
+		if (!this->inboundLimiter.limited()) return;
+		std::scoped_lock<std::mutex> lock(this->muxInboundLimit);
+		this->inboundLimiter.consume(1, bytes);
+	}
+
+	/// <summary>
+	/// Time until server_options::inboundLimit is out of debt, connections wait this long
+	/// before they read again.
+	/// </summary>
+	/// <returns></returns>
+	std::chrono::steady_clock::duration inboundDelay() {
+		if (!this->inboundLimiter.limited()) return std::chrono::steady_clock::duration::zero();
+		std::scoped_lock<std::mutex> lock(this->muxInboundLimit);
+		return this->inboundLimiter.delay();
+	}
+
+	inline bool inboundLimited() const { return this->inboundLimiter.limited(); }
+
+	/// <summary>
+	/// Called when a client is validated. Runs on one of the asio threads.
 	/// </summary>
 	/// <param name="client"></param>
 	virtual void onClientValidated(ref<connection<T>> client) {}
 
+	/// <summary>
+	/// Called when the outgoing bytes of a client reach connection_options::highWatermarkBytes.
+	/// Runs on the thread that sent the message.
+	/// </summary>
+	/// <param name="client"></param>
+	virtual void onClientHighWatermark(ref<connection<T>> client) {}
+
+	/// <summary>
+	/// Called when the outgoing bytes of a client that reached the high watermark have
+	/// drained to connection_options::lowWatermarkBytes. Runs on the asio thread.
+	/// </summary>
+	/// <param name="client"></param>
+	virtual void onClientLowWatermark(ref<connection<T>> client) {}
+
 protected:
-	tsqueue<owned_message<T>> qMessagesIn;							// Thread safe Queue for incoming message packets.
-		
-	std::deque<ref<connection<T>>> deqConnections;					// Container of active validated connections
+	server_options options;
+	std::atomic<size_t> nDispatchInFlight{ 0 };						// See server_options::maxDispatchInFlight ...
+	std::mutex muxDispatch;											// ... an update() waiting for room ...
+	std::condition_variable dispatchRoom;							// ... sleeps on this, declared before the dispatch threads that notify it
+	std::exception_ptr dispatchError;								// First exception the dispatch threads caught from onMessage, guarded by muxDispatch ...
+	std::atomic<bool> hasDispatchError{ false };					// ... and set with it, so update() only locks when there is one
+	scope<asio::thread_pool> dispatchPool;							// Calls onMessage in parallel dispatch mode, outlives the connection strands
+	std::vector<scope<server_shard<T>>> vecShards;					// Each shard handles the data transfer of its own connections, declared before anything holding connections
+
+	std::vector<owned_message<T>> vecIncomingBatch;					// Messages taken from the shards' inbound queues by update(), kept to reuse its capacity
+	size_t nNextDrainShard = 0;										// Shard takeIncoming starts at, only touched by update()
+	std::atomic<bool> updateParked{ false };						// update() waits for a message ...
+	std::mutex muxIncoming;											// ... on this mutex ...
+	std::condition_variable incomingReady;							// ... and condition variable, see notifyIncoming
+
+	struct inbound_flow {
+		std::deque<owned_message<T>> messages;
+		size_t deficit = 0;											// Bytes the client may still dispatch in its turn
+		bool inTurn = false;										// The deficit of the current turn was granted
+		codel aqm;
+	};
+	std::unordered_map<uint32_t, inbound_flow> mapFlows;			// Per client queues of fair inbound scheduling, only clients with messages waiting ...
+	std::deque<uint32_t> deqActiveFlows;							// ... in the order of their turns, only touched by update()
+	codel inboundCodel{ options.sheddingTarget, options.sheddingInterval };	// Sheds from the inbound queues in fifo inbound scheduling
+
+	std::unordered_map<uint32_t, uint64_t> mapShed;					// Messages shed per message ID ...
+	std::mutex muxShed;												// ... written by update(), read by getShedMessages
+	std::atomic<uint64_t> nShed{ 0 };
 
-	asio::io_context context;										// asio context handles the data transfer ...
-	std::thread threadContext;										// ... but also needs athread of it's own to execute commands
+	connection_options connOptions;									// Handed to every accepted connection
+	shared_message<T> heartbeat;									// See setHeartbeatMessage
 
-	asio::ip::tcp::acceptor asioAcceptor;
+	rate_limiter inboundLimiter;									// Server wide inbound limit ...
+	std::mutex muxInboundLimit;										// ... charged by the connections of every shard
 
-	uint32_t cIDCounter = 10000;									// Clients will be identified in the system via ID codes
+	size_t nNextShard = 0;											// Next shard to receive a connection when the first shard accepts for all, only used on its accept strand
 };
 
 END_NET_NS
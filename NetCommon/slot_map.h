@@ -0,0 +1,171 @@
+/*
+ * NetWeave - C++ Networking Library
+ * Copyright 2024 - Jessy van Polanen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NETWORK_SLOT_MAP_
+#define _NETWORK_SLOT_MAP_
+
+#include "net_common.h"
+
+BEGIN_NET_NS
+
+/// <summary>
+/// Handle to a value in a slot_map. The generation tells apart the values that used the
+/// same slot over time, so a handle to an erased value never finds its successor.
+/// </summary>
+struct slot_key {
+	uint32_t index = 0;
+	uint32_t generation = 0;			// Never 0 for a key handed out by a slot_map
+};
+
+/// <summary>
+/// Generational slot map. Insert, find and erase are O(1), and the values are kept next to
+/// each other in one vector, so iterating over them is a linear walk. Erasing moves the last
+/// value into the hole, which means the order of the values is not stable but keys are.
+/// Generations count from 1 to 2^GenerationBits - 1 and then wrap, so a stale key is only
+/// mistaken for a live one after that many reuses of its slot.
+/// </summary>
+/// <typeparam name="V"></typeparam>
+/// <typeparam name="GenerationBits"></typeparam>
+template <typename V, uint32_t GenerationBits = 32>
+class slot_map {
+public:
+	static_assert(GenerationBits > 0 && GenerationBits <= 32, "Generations need between 1 and 32 bits!");
+	static constexpr uint32_t maxGeneration = uint32_t((uint64_t(1) << GenerationBits) - 1);
+
+public:
+	/// <summary>
+	/// Stores a value in a free slot, reusing erased slots first.
+	/// </summary>
+	/// <param name="value"></param>
+	/// <returns>Key of the value</returns>
+	slot_key insert(V value) {
+		uint32_t index;
+		if (this->nFreeHead != npos) {
+			index = this->nFreeHead;
+			this->nFreeHead = this->vecSlots[index].position;
+		}
+		else {
+			index = uint32_t(this->vecSlots.size());
+			this->vecSlots.push_back(slot{});
+		}
+
+		slot& s = this->vecSlots[index];
+		s.position = uint32_t(this->vecValues.size());
+		this->vecValues.push_back(std::move(value));
+		this->vecIndices.push_back(index);
+		return slot_key{ index, s.generation };
+	}
+
+	/// <summary>
+	/// Index the next insert() will use.
+	/// </summary>
+	/// <returns></returns>
+	uint32_t nextIndex() const {
+		return this->nFreeHead != npos ? this->nFreeHead : uint32_t(this->vecSlots.size());
+	}
+
+	/// <summary>
+	/// Looks up a value.
+	/// </summary>
+	/// <param name="key"></param>
+	/// <returns>The value, nullptr if the key was erased</returns>
+	V* find(slot_key key) {
+		if (!this->contains(key)) return nullptr;
+		return &this->vecValues[this->vecSlots[key.index].position];
+	}
+
+	const V* find(slot_key key) const {
+		if (!this->contains(key)) return nullptr;
+		return &this->vecValues[this->vecSlots[key.index].position];
+	}
+
+	bool contains(slot_key key) const {
+		return key.index < this->vecSlots.size()
+			&& this->vecSlots[key.index].generation == key.generation
+			&& this->vecSlots[key.index].position < this->vecValues.size()
+			&& this->vecIndices[this->vecSlots[key.index].position] == key.index;
+	}
+
+	/// <summary>
+	/// Removes a value, the key and all its copies stop finding anything.
+	/// </summary>
+	/// <param name="key"></param>
+	/// <returns>False if the key was already erased</returns>
+	bool erase(slot_key key) {
+		if (!this->contains(key)) return false;
+
+		slot& s = this->vecSlots[key.index];
+		uint32_t position = s.position;
+		uint32_t last = uint32_t(this->vecValues.size() - 1);
+		if (position != last) {
+			this->vecValues[position] = std::move(this->vecValues[last]);
+			this->vecIndices[position] = this->vecIndices[last];
+			this->vecSlots[this->vecIndices[position]].position = position;
+		}
+		this->vecValues.pop_back();
+		this->vecIndices.pop_back();
+
+		s.generation = s.generation == maxGeneration ? 1 : s.generation + 1;
+		s.position = this->nFreeHead;
+		this->nFreeHead = key.index;
+		return true;
+	}
+
+	/// <summary>
+	/// Key of the value at a position of the dense storage, for use while iterating.
+	/// </summary>
+	/// <param name="position"></param>
+	/// <returns></returns>
+	slot_key keyAt(size_t position) const {
+		uint32_t index = this->vecIndices[position];
+		return slot_key{ index, this->vecSlots[index].generation };
+	}
+
+	/// <summary>
+	/// Removes all values, every key handed out so far becomes stale.
+	/// </summary>
+	void clear() {
+		for (size_t i = this->vecValues.size(); i > 0; i--)
+			this->erase(this->keyAt(i - 1));
+	}
+
+	inline size_t size() const { return this->vecValues.size(); }
+	inline bool empty() const { return this->vecValues.empty(); }
+
+	inline typename std::vector<V>::iterator begin() { return this->vecValues.begin(); }
+	inline typename std::vector<V>::iterator end() { return this->vecValues.end(); }
+	inline typename std::vector<V>::const_iterator begin() const { return this->vecValues.begin(); }
+	inline typename std::vector<V>::const_iterator end() const { return this->vecValues.end(); }
+
+private:
+	static constexpr uint32_t npos = uint32_t(-1);
+
+	struct slot {
+		uint32_t generation = 1;
+		uint32_t position = 0;			// Position in vecValues while used, next free slot while free
+	};
+
+private:
+	std::vector<slot> vecSlots;
+	std::vector<V> vecValues;				// Dense storage of the values ...
+	std::vector<uint32_t> vecIndices;		// ... and the slot each of them belongs to
+	uint32_t nFreeHead = npos;				// First free slot, the free slots form a list through slot::position
+};
+
+END_NET_NS
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ * NetWeave - C++ Networking Library
+ * Copyright 2024 - Jessy van Polanen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NETWORK_TIMING_WHEEL_
+#define _NETWORK_TIMING_WHEEL_
+
+#include "net_common.h"
+#include "slot_map.h"
+
+BEGIN_NET_NS
+
+/// <summary>
+/// Hierarchical timing wheel. Time is cut into ticks, and timers are hashed into the slots of
+/// one of four wheels of 256 slots by how far away they are: the first wheel holds the next 256
+/// ticks, each next wheel covers 256 times the range of the one before it. When a wheel
+/// wraps, the current slot of the wheel above is spread over the wheels below.
+/// Scheduling and cancelling are O(1) list operations. Timers fire at most one tick late.
+/// All members may be called from any thread, callbacks run on the thread calling advance()
+/// after the lock is released, so they may schedule and cancel timers themselves.
+/// </summary>
+class timing_wheel {
+public:
+	using clock = std::chrono::steady_clock;
+	using callback = std::function<void()>;
+
+	static constexpr uint32_t levels = 4;
+	static constexpr uint32_t slotBits = 8;
+	static constexpr uint32_t slots = 1u << slotBits;
+
+public:
+	timing_wheel(std::chrono::milliseconds tick = std::chrono::milliseconds(10))
+		: tick(std::max(tick, std::chrono::milliseconds(1))), start(clock::now())
+	{
+		for (auto& level : this->wheels) level.fill(npos);
+	}
+
+	timing_wheel(const timing_wheel&) = delete;
+
+public:
+	/// <summary>
+	/// Runs fn once after delay.
+	/// </summary>
+	/// <param name="delay"></param>
+	/// <param name="fn"></param>
+	/// <returns>Handle to cancel the timer with</returns>
+	slot_key schedule(clock::duration delay, callback fn) {
+		std::scoped_lock lock(this->muxWheel);
+		uint32_t index = this->allocateNode();
+		node& n = this->vecNodes[index];
+		n.fn = std::move(fn);
+		n.deadline = this->deadlineOf(delay);
+		this->link(index);
+		this->nActive++;
+		return slot_key{ index, n.generation };
+	}
+
+	/// <summary>
+	/// Stops a timer that has not fired yet.
+	/// </summary>
+	/// <param name="key"></param>
+	/// <returns>False if the timer already fired or was cancelled</returns>
+	bool cancel(slot_key key) {
+		callback fn;
+		{
+			std::scoped_lock lock(this->muxWheel);
+			if (!this->isPending(key)) return false;
+
+			this->unlink(key.index);
+			fn = this->freeNode(key.index);
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Moves a timer that has not fired yet to a new delay from now.
+	/// </summary>
+	/// <param name="key"></param>
+	/// <param name="delay"></param>
+	/// <returns>False if the timer already fired or was cancelled</returns>
+	bool reschedule(slot_key key, clock::duration delay) {
+		std::scoped_lock lock(this->muxWheel);
+		if (!this->isPending(key)) return false;
+
+		this->unlink(key.index);
+		this->vecNodes[key.index].deadline = this->deadlineOf(delay);
+		this->link(key.index);
+		return true;
+	}
+
+	/// <summary>
+	/// Processes every tick up to now and runs the timers that expired.
+	/// </summary>
+	/// <param name="now"></param>
+	/// <returns>Number of timers that fired</returns>
+	size_t advance(clock::time_point now = clock::now()) {
+		uint64_t target = uint64_t((now - this->start) / this->tick);
+		{
+			std::scoped_lock lock(this->muxWheel);
+			while (this->nCurrentTick < target) {
+				this->nCurrentTick++;
+				this->cascade();
+
+				uint32_t& head = this->wheels[0][this->nCurrentTick & (slots - 1)];
+				while (head != npos) {
+					uint32_t index = head;
+					this->unlink(index);
+					this->vecExpired.push_back(this->freeNode(index));
+				}
+			}
+		}
+
+		size_t fired = this->vecExpired.size();
+		for (callback& fn : this->vecExpired)
+			fn();
+		this->vecExpired.clear();
+		return fired;
+	}
+
+	/// <summary>
+	/// Time until the next tick is due.
+	/// </summary>
+	/// <param name="now"></param>
+	/// <returns></returns>
+	clock::duration untilNextTick(clock::time_point now = clock::now()) const {
+		clock::duration elapsed = (now - this->start) % this->tick;
+		return this->tick - elapsed;
+	}
+
+	inline std::chrono::milliseconds getTick() const { return this->tick; }
+
+	/// <summary>
+	/// Number of timers that have not fired or been cancelled.
+	/// </summary>
+	/// <returns></returns>
+	size_t size() {
+		std::scoped_lock lock(this->muxWheel);
+		return this->nActive;
+	}
+
+private:
+	static constexpr uint32_t npos = uint32_t(-1);
+
+	struct node {
+		callback fn;
+		uint64_t deadline = 0;			// Tick the timer fires on
+		uint32_t prev = npos;
+		uint32_t next = npos;			// Also links the free nodes
+		uint32_t generation = 1;
+		uint16_t level = 0;
+		uint16_t slot = 0;
+		bool pending = false;
+	};
+
+	bool isPending(slot_key key) const {
+		return key.index < this->vecNodes.size()
+			&& this->vecNodes[key.index].generation == key.generation
+			&& this->vecNodes[key.index].pending;
+	}
+
+	/// <summary>
+	/// Tick a delay from now ends on, never the tick that is being processed.
+	/// </summary>
+	uint64_t deadlineOf(clock::duration delay) const {
+		clock::duration since = clock::now() - this->start + std::max(delay, clock::duration::zero());
+		uint64_t deadline = uint64_t((since + this->tick - clock::duration(1)) / this->tick);
+		uint64_t maxDeadline = this->nCurrentTick + (uint64_t(1) << (slotBits * levels)) - 1;
+		return std::clamp(deadline, this->nCurrentTick + 1, maxDeadline);
+	}
+
+	/// <summary>
+	/// Puts a node in the slot of the lowest wheel its deadline fits in.
+	/// </summary>
+	void link(uint32_t index) {
+		node& n = this->vecNodes[index];
+		uint64_t delta = n.deadline > this->nCurrentTick ? n.deadline - this->nCurrentTick : 0;
+
+		uint32_t level = 0;
+		while (level + 1 < levels && delta >= (uint64_t(1) << (slotBits * (level + 1))))
+			level++;
+
+		n.level = uint16_t(level);
+		n.slot = uint16_t((n.deadline >> (slotBits * level)) & (slots - 1));
+		n.prev = npos;
+		n.next = this->wheels[level][n.slot];
+		if (n.next != npos) this->vecNodes[n.next].prev = index;
+		this->wheels[level][n.slot] = index;
+		n.pending = true;
+	}
+
+	void unlink(uint32_t index) {
+		node& n = this->vecNodes[index];
+		if (n.prev != npos) this->vecNodes[n.prev].next = n.next;
+		else this->wheels[n.level][n.slot] = n.next;
+		if (n.next != npos) this->vecNodes[n.next].prev = n.prev;
+		n.prev = n.next = npos;
+		n.pending = false;
+	}
+
+	/// <summary>
+	/// When the lower wheels wrapped on this tick, moves the timers of the current slot of the
+	/// wheels above down to where their deadline now fits.
+	/// </summary>
+	void cascade() {
+		for (uint32_t level = 1; level < levels; level++) {
+			if ((this->nCurrentTick & ((uint64_t(1) << (slotBits * level)) - 1)) != 0)
+				return;
+
+			uint32_t& head = this->wheels[level][(this->nCurrentTick >> (slotBits * level)) & (slots - 1)];
+			uint32_t index = head;
+			head = npos;
+			while (index != npos) {
+				uint32_t next = this->vecNodes[index].next;
+				this->link(index);
+				index = next;
+			}
+		}
+	}
+
+	uint32_t allocateNode() {
+		if (this->nFreeHead != npos) {
+			uint32_t index = this->nFreeHead;
+			this->nFreeHead = this->vecNodes[index].next;
+			return index;
+		}
+		this->vecNodes.emplace_back();
+		return uint32_t(this->vecNodes.size() - 1);
+	}
+
+	/// <summary>
+	/// Returns a node to the free list, the callback is handed back so it can be run or
+	/// destroyed outside the lock.
+	/// </summary>
+	callback freeNode(uint32_t index) {
+		node& n = this->vecNodes[index];
+		callback fn = std::move(n.fn);
+		n.fn = nullptr;
+		n.generation = n.generation == uint32_t(-1) ? 1 : n.generation + 1;
+		n.next = this->nFreeHead;
+		this->nFreeHead = index;
+		this->nActive--;
+		return fn;
+	}
+
+private:
+	const std::chrono::milliseconds tick;
+	const clock::time_point start;
+	uint64_t nCurrentTick = 0;						// Last tick that was processed
+
+	std::array<std::array<uint32_t, slots>, levels> wheels;	// First node of every slot
+	std::vector<node> vecNodes;
+	uint32_t nFreeHead = npos;
+	size_t nActive = 0;
+	std::vector<callback> vecExpired;				// Only used by advance(), which runs on one thread at a time
+	std::mutex muxWheel;
+public:
+	timing_wheel& operator = (const timing_wheel&) = delete;
+};
+
+END_NET_NS
+
+#endif
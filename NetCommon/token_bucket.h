@@ -0,0 +1,160 @@
+/*
+ * NetWeave - C++ Networking Library
+ * Copyright 2024 - Jessy van Polanen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NETWORK_TOKEN_BUCKET_
+#define _NETWORK_TOKEN_BUCKET_
+
+#include "net_common.h"
+#include <limits>
+
+BEGIN_NET_NS
+
+/// <summary>
+/// Limits on the message rate and byte rate of a stream of messages. A rate of 0 leaves that
+/// rate unlimited, a burst of 0 allows one second worth of the rate at once.
+/// </summary>
+struct rate_limit {
+	double messagesPerSecond = 0;
+	double messageBurst = 0;
+	double bytesPerSecond = 0;
+	double byteBurst = 0;
+
+	inline bool limited() const { return this->messagesPerSecond > 0 || this->bytesPerSecond > 0; }
+};
+
+/// <summary>
+/// Token bucket that refills at a fixed rate up to its burst size. Consuming may take the
+/// bucket below zero, the debt is what delay() waits out, so a single large message is
+/// never stuck behind a burst size that is too small for it.
+/// Not thread safe.
+/// </summary>
+class token_bucket {
+public:
+	using clock = std::chrono::steady_clock;
+
+public:
+	token_bucket() = default;
+
+	token_bucket(double rate, double burst)
+		: rate(rate), burst(burst > 0 ? burst : rate), tokens(burst > 0 ? burst : rate), last(clock::now())
+	{}
+
+public:
+	inline bool limited() const { return this->rate > 0; }
+
+	/// <summary>
+	/// Takes tokens from the bucket, going into debt if there are not enough.
+	/// </summary>
+	/// <param name="amount"></param>
+	/// <param name="now"></param>
+	void consume(double amount, clock::time_point now = clock::now()) {
+		if (!this->limited()) return;
+		this->refill(now);
+		this->tokens -= amount;
+	}
+
+	/// <summary>
+	/// Tokens that can be taken without going into debt.
+	/// </summary>
+	/// <param name="now"></param>
+	/// <returns>Infinity if the bucket is not limited</returns>
+	double available(clock::time_point now = clock::now()) {
+		if (!this->limited()) return std::numeric_limits<double>::infinity();
+		this->refill(now);
+		return this->tokens;
+	}
+
+	/// <summary>
+	/// Time until the bucket is out of debt.
+	/// </summary>
+	/// <param name="now"></param>
+	/// <returns>Zero if tokens are available</returns>
+	clock::duration delay(clock::time_point now = clock::now()) {
+		if (!this->limited()) return clock::duration::zero();
+		this->refill(now);
+		if (this->tokens >= 0) return clock::duration::zero();
+		return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(-this->tokens / this->rate));
+	}
+
+private:
+	void refill(clock::time_point now) {
+		if (now <= this->last) return;
+		double elapsed = std::chrono::duration<double>(now - this->last).count();
+		this->tokens = std::min(this->burst, this->tokens + elapsed * this->rate);
+		this->last = now;
+	}
+
+private:
+	double rate = 0;
+	double burst = 0;
+	double tokens = 0;
+	clock::time_point last;
+};
+
+/// <summary>
+/// Message and byte bucket of one rate_limit. Not thread safe.
+/// </summary>
+class rate_limiter {
+public:
+	using clock = token_bucket::clock;
+
+public:
+	rate_limiter() = default;
+
+	explicit rate_limiter(const rate_limit& limit)
+		: messages(limit.messagesPerSecond, limit.messageBurst), bytes(limit.bytesPerSecond, limit.byteBurst)
+	{}
+
+public:
+	inline bool limited() const { return this->messages.limited() || this->bytes.limited(); }
+
+	void consume(size_t messageCount, size_t byteCount, clock::time_point now = clock::now()) {
+		this->messages.consume(double(messageCount), now);
+		this->bytes.consume(double(byteCount), now);
+	}
+
+	/// <summary>
+	/// Whether another message of the given size still fits in both buckets on top of what a
+	/// batch already holds.
+	/// </summary>
+	/// <param name="messageCount">Messages already in the batch</param>
+	/// <param name="byteCount">Bytes already in the batch</param>
+	/// <param name="size">Size of the next message</param>
+	/// <param name="now"></param>
+	/// <returns></returns>
+	bool fits(size_t messageCount, size_t byteCount, size_t size, clock::time_point now = clock::now()) {
+		return double(messageCount + 1) <= this->messages.available(now)
+			&& double(byteCount + size) <= this->bytes.available(now);
+	}
+
+	/// <summary>
+	/// Time until both buckets are out of debt.
+	/// </summary>
+	/// <param name="now"></param>
+	/// <returns></returns>
+	clock::duration delay(clock::time_point now = clock::now()) {
+		return std::max(this->messages.delay(now), this->bytes.delay(now));
+	}
+
+private:
+	token_bucket messages;
+	token_bucket bytes;
+};
+
+END_NET_NS
+
+#endif
@@ -41,16 +41,34 @@ public:
 	}
 
 	void push_back(const T& item) {
+		this->emplace_back(item);
+	}
+
+	void push_back(T&& item) {
+		this->emplace_back(std::move(item));
+	}
+
+	template <typename... Args>
+	void emplace_back(Args&&... args) {
 		std::scoped_lock<std::mutex> lock(muxQueue);
-		this->deqQueue.emplace_back(std::move(item));
+		this->deqQueue.emplace_back(std::forward<Args>(args)...);
 
 		std::unique_lock<std::mutex> ul(this->muxBlocking);
 		this->blocking.notify_one();
 	}
 
 	void push_front(const T& item) {
+		this->emplace_front(item);
+	}
+
+	void push_front(T&& item) {
+		this->emplace_front(std::move(item));
+	}
+
+	template <typename... Args>
+	void emplace_front(Args&&... args) {
 		std::scoped_lock<std::mutex> lock(muxQueue);
-		this->deqQueue.emplace_front(std::move(item));
+		this->deqQueue.emplace_front(std::forward<Args>(args)...);
 
 		std::unique_lock<std::mutex> ul(this->muxBlocking);
 		this->blocking.notify_one();
@@ -81,10 +99,28 @@ public:
 	T pop_back() {
 		std::scoped_lock<std::mutex> lock(muxQueue);
 		auto i = std::move(this->deqQueue.back());
-		deqQueue.pop_front();
+		deqQueue.pop_back();
 		return i;
 	}
 
+	/// <summary>
+	/// Moves up to maxItems elements from the front of the queue to the back of out,
+	/// taking the lock once for the whole batch.
+	/// </summary>
+	/// <param name="out"></param>
+	/// <param name="maxItems"></param>
+	/// <returns>Number of elements moved</returns>
+	size_t pop_all(std::vector<T>& out, size_t maxItems = size_t(-1)) {
+		std::scoped_lock<std::mutex> lock(muxQueue);
+		size_t n = std::min(maxItems, this->deqQueue.size());
+		out.insert(
+			out.end(),
+			std::make_move_iterator(this->deqQueue.begin()),
+			std::make_move_iterator(this->deqQueue.begin() + n));
+		this->deqQueue.erase(this->deqQueue.begin(), this->deqQueue.begin() + n);
+		return n;
+	}
+
 	void wait() {
 		while (this->empty()) {
 			std::unique_lock<std::mutex> ul(this->muxBlocking);
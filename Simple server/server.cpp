@@ -7,6 +7,10 @@ public:
 		: net::server_interface<net::message_types>(port)
 	{}
 
+	~CustomServer() {
+		this->stop();
+	}
+
 protected:
 	bool onClientConnect(std::shared_ptr<net::connection<net::message_types>> client) override {
 		net::message<net::message_types> msg;
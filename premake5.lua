@@ -129,3 +129,46 @@ project "Simple server"
 
 	filter "system:windows"
 		systemversion "latest"
+
+project "Benchmark"
+	location "Benchmark"
+	kind "ConsoleApp"
+	language "C++"
+	staticruntime "on"
+	cppdialect "C++17"
+
+	targetdir ("bin/" .. outputdir .. "/%{prj.name}")
+	objdir ("bin-int/" .. outputdir .. "/%{prj.name}")
+
+	files {
+		"%{prj.name}/**.h",
+		"%{prj.name}/**.hpp",
+		"%{prj.name}/**.cpp",
+	}
+
+	includedirs {
+		"Libraries/include",
+		"NetCommon",
+	}
+
+	libdirs {
+		"Libraries/lib",
+	}
+
+	links {
+		"NetCommon",
+	}
+
+	filter "system:windows"
+		systemversion "latest"
+
+	filter "system:linux"
+		links { "pthread" }
+
+	filter "configurations:Release"
+		optimize "on"
+		runtime "Release"
+
+	filter "configurations:Dist"
+		optimize "on"
+		runtime "Release"